@@ -2,8 +2,8 @@
 // PackedCell.hpp
 // Single-header, minimal-duplication packed 64-bit cell utilities.
 // Two pack modes supported:
-//   MODE_VALUE32 : [ value:32 | clk16:16 | st:8 | rel:8 ]
-//   MODE_CLK48   : [ clk48:48  | st:8  | rel:8 ]
+//   MODE_VALUE32 : [ value:32 | clk16:16 | rel:8 | st:8 ]   (low -> high bits)
+//   MODE_CLK48   : [ clk48:48  | rel:8  | st:8 ]
 //
 // Hot path optimization: top-16 bits (st|rel) are extracted via a single >>48 + &0xFFFF.
 // Minimal branching via constexpr mode-dispatch.
@@ -39,19 +39,19 @@ static inline constexpr packed64_t low_mask(unsigned n) noexcept {
 // Compact, minimal API. All functions are noexcept and small.
 struct PackedCell {
     // Compose (value32 layout)
-    static inline packed64_t compose_value32(val32_t v, clk16_t clk, tag8_t st, tag8_t rel) noexcept {
+    static inline constexpr packed64_t compose_value32(val32_t v, clk16_t clk, tag8_t st, tag8_t rel) noexcept {
         packed64_t p = (packed64_t(v) & low_mask(VALBITS));
         p |= (packed64_t(clk) & low_mask(CLK16B)) << VALBITS;
-        p |= (packed64_t(st)  & low_mask(8u)) << (VALBITS + CLK16B);
-        p |= (packed64_t(rel) & low_mask(8u)) << (VALBITS + CLK16B + 8u);
+        p |= (packed64_t(rel) & low_mask(8u)) << (VALBITS + CLK16B);
+        p |= (packed64_t(st)  & low_mask(8u)) << (VALBITS + CLK16B + 8u);
         return p;
     }
 
     // Compose (clk48 layout)
-    static inline packed64_t compose_clk48(clk48_t clk, tag8_t st, tag8_t rel) noexcept {
+    static inline constexpr packed64_t compose_clk48(clk48_t clk, tag8_t st, tag8_t rel) noexcept {
         packed64_t p = (packed64_t(clk) & low_mask(CLK48B));
-        p |= (packed64_t(st)  & low_mask(8u)) << CLK48B;
-        p |= (packed64_t(rel) & low_mask(8u)) << (CLK48B + 8u);
+        p |= (packed64_t(rel) & low_mask(8u)) << CLK48B;
+        p |= (packed64_t(st)  & low_mask(8u)) << (CLK48B + 8u);
         return p;
     }
 
@@ -160,7 +160,8 @@ struct PackedProxy {
 // PackedStRel.h
 // Canonical states and relation masks. Use bitmask relations (one slot can address many consumers).
 
-#include "PackedCell.hpp"
+#include <atomic>
+#include <type_traits>
 
 namespace AtomicCScompact {
 
@@ -174,8 +175,14 @@ static constexpr tag8_t ST_COMPLETE    = 0x05;
 static constexpr tag8_t ST_RETIRED     = 0x06;
 static constexpr tag8_t ST_EPOCH_BUMP  = 0x07;
 static constexpr tag8_t ST_LOCKED      = 0x08;
+static constexpr tag8_t ST_RLU_LOCKED  = 0x09; // cell copied into an RluArray write log
 // Reserve 0xF0..0xFF for user extensions
 
+// An idle cell (ST_IDLE, rel 0, value/clock 0) is all-zero bits in both layouts, so zero-filled
+// pages from AllocNW or a fresh file/segment already hold idle cells and need no construct pass.
+static_assert(PackedCell::compose_value32(0, 0, ST_IDLE, 0) == 0 && PackedCell::compose_clk48(0, ST_IDLE, 0) == 0);
+static_assert(std::is_trivially_destructible_v<std::atomic<packed64_t>>);
+
 // Relation bit masks (8-bit)
 static constexpr tag8_t REL_NONE      = 0x00;
 static constexpr tag8_t REL_NODE0     = 0x01;
@@ -194,329 +201,2673 @@ static inline bool rel_matches(tag8_t slot_rel, tag8_t rel_mask) noexcept {
 
 } // namespace AtomicCScompact
 #pragma once
-// MPMCArrayPacked.hpp
-// Slot-array mailbox specialized for packed64_t (PackedCell).
-// The array is NUMA-allocated via AllocNW::AlignedAllocONnode (no fallback).
-// Designed for CPU<->GPU mailbox usage: consumers scan slots and claim by rel mask.
+// PackedScan.hpp
+// Block scan kernels over packed64_t arrays: test the top-16 st|rel bits of many cells per
+// instruction and turn the resulting match masks into indices / run ranges.
+// ISA is picked once at runtime (AVX-512 / AVX2 / SSE4.2 / scalar); x86 kernels are compiled
+// with per-function target attributes so the baseline build flags stay unchanged.
+// Scans are relaxed snapshots, same as the per-cell load() loops they replace.
 
+#include <algorithm>
 #include <atomic>
+#include <bit>
 #include <cstddef>
 #include <cstdint>
+#include <utility>
 #include <vector>
-#include <chrono>
-#include <thread>
-#include <bit>
-#include <cassert>
 
-#include "PackedCell.hpp"
-#include "PackedStRel.h"
-#include "AllocNW.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #include <immintrin.h>
+    #define ACS_SCAN_X86 1
+#else
+    #define ACS_SCAN_X86 0
+#endif
 
 namespace AtomicCScompact {
+namespace PackedScan {
 
-using packed64_t = ::AtomicCScompact::packed64_t;
-using tag8_t     = ::AtomicCScompact::tag8_t;
-using strel_t    = ::AtomicCScompact::strel_t;
-using PackedMode = ::AtomicCScompact::PackedMode;
+enum class Isa : int { SCALAR = 0, SSE42 = 1, AVX2 = 2, AVX512 = 3 };
 
-using HWCallback = void(*)(size_t current, size_t capacity, void* user);
+// predicate on one 64-bit cell: any-bit => (p & bits) != 0, else (p & bits) == val
+// Each kernel returns a bitmask for up to 64 cells starting at p.
+using MaskKernel = uint64_t(*)(const packed64_t* p, size_t n, packed64_t bits, packed64_t val, bool any_bit);
 
-static inline constexpr uint64_t HASH_CONST = 11400714819323198485ull;
+static inline uint64_t mask_scalar(const packed64_t* p, size_t n, packed64_t bits, packed64_t val, bool any_bit) noexcept {
+    uint64_t m = 0;
+    if (any_bit) { for (size_t i = 0; i < n; ++i) m |= uint64_t((p[i] & bits) != 0) << i; }
+    else         { for (size_t i = 0; i < n; ++i) m |= uint64_t((p[i] & bits) == val) << i; }
+    return m;
+}
 
-template<PackedMode MODE>
-class MPMCArrayPacked {
-public:
-    MPMCArrayPacked(size_t capacity, int node = 0, HWCallback hw_cb = nullptr, void* cb_user = nullptr)
-      : capacity_(capacity), cb_(hw_cb), cb_user_(cb_user), node_(node)
-    {
-        if (capacity_ == 0) throw std::invalid_argument("capacity==0");
-        size_t bytes = sizeof(std::atomic<packed64_t>) * capacity_;
-        raw_ = reinterpret_cast<std::atomic<packed64_t>*>(AllocNW::AlignedAllocONnode(64, bytes, node_));
-        if (!raw_) throw std::bad_alloc();
-        packed64_t idle = make_idle();
-        for (size_t i = 0; i < capacity_; ++i) new (&raw_[i]) std::atomic<packed64_t>(idle);
-        occ_.store(0, std::memory_order_relaxed);
-        prod_cursor_.store(0, std::memory_order_relaxed);
-        cons_cursor_.store(0, std::memory_order_relaxed);
+#if ACS_SCAN_X86
+__attribute__((target("sse4.2")))
+static inline uint64_t mask_sse42(const packed64_t* p, size_t n, packed64_t bits, packed64_t val, bool any_bit) noexcept {
+    const __m128i vb = _mm_set1_epi64x(static_cast<long long>(bits));
+    const __m128i vv = _mm_set1_epi64x(static_cast<long long>(any_bit ? 0 : val));
+    uint64_t m = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i a = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)), vb);
+        __m128i b = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 2)), vb);
+        unsigned ma = static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(a, vv))));
+        unsigned mb = static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(b, vv))));
+        unsigned q = ma | (mb << 2);
+        if (any_bit) q = ~q & 0xFu;
+        m |= uint64_t(q) << i;
     }
+    if (i < n) m |= mask_scalar(p + i, n - i, bits, val, any_bit) << i;
+    return m;
+}
 
-    ~MPMCArrayPacked() {
-        if (raw_) {
-            for (size_t i = 0; i < capacity_; ++i) raw_[i].~atomic();
-            size_t bytes = sizeof(std::atomic<packed64_t>) * capacity_;
-            AllocNW::FreeONNode(static_cast<void*>(raw_), bytes);
-            raw_ = nullptr;
+__attribute__((target("avx2")))
+static inline uint64_t mask_avx2(const packed64_t* p, size_t n, packed64_t bits, packed64_t val, bool any_bit) noexcept {
+    const __m256i vb = _mm256_set1_epi64x(static_cast<long long>(bits));
+    const __m256i vv = _mm256_set1_epi64x(static_cast<long long>(any_bit ? 0 : val));
+    uint64_t m = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        unsigned q = 0;
+        for (unsigned k = 0; k < 4; ++k) {
+            __m256i a = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 4 * k)), vb);
+            q |= static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(a, vv)))) << (4 * k);
         }
+        if (any_bit) q = ~q & 0xFFFFu;
+        m |= uint64_t(q) << i;
     }
+    if (i < n) m |= mask_scalar(p + i, n - i, bits, val, any_bit) << i;
+    return m;
+}
 
-    MPMCArrayPacked(const MPMCArrayPacked&) = delete;
-    MPMCArrayPacked& operator=(const MPMCArrayPacked&) = delete;
-
-    size_t capacity() const noexcept { return capacity_; }
-    size_t occupancy() const noexcept { return occ_.load(std::memory_order_acquire); }
+__attribute__((target("avx512f")))
+static inline uint64_t mask_avx512(const packed64_t* p, size_t n, packed64_t bits, packed64_t val, bool any_bit) noexcept {
+    const __m512i vb = _mm512_set1_epi64(static_cast<long long>(bits));
+    const __m512i vv = _mm512_set1_epi64(static_cast<long long>(val));
+    uint64_t m = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i a = _mm512_loadu_si512(p + i);
+        __m512i b = _mm512_loadu_si512(p + i + 8);
+        unsigned q;
+        if (any_bit) q = unsigned(_mm512_test_epi64_mask(a, vb)) | (unsigned(_mm512_test_epi64_mask(b, vb)) << 8);
+        else q = unsigned(_mm512_cmpeq_epi64_mask(_mm512_and_si512(a, vb), vv)) | (unsigned(_mm512_cmpeq_epi64_mask(_mm512_and_si512(b, vb), vv)) << 8);
+        m |= uint64_t(q) << i;
+    }
+    if (i < n) m |= mask_scalar(p + i, n - i, bits, val, any_bit) << i;
+    return m;
+}
+#endif
 
-    // publish: place item with ST_PUBLISHED into any free slot. Returns index or SIZE_MAX.
-    size_t publish(packed64_t item, int max_probes = -1) noexcept {
-        // ensure ST_PUBLISHED in top byte
-        strel_t sr = PackedCell::extract_strel(item);
-        if (PackedCell::st_from_strel(sr) != ST_PUBLISHED) {
-            tag8_t rel = PackedCell::rel_from_strel(sr);
-            if constexpr (MODE == PackedMode::MODE_VALUE32)
-                item = PackedCell::compose_value32(PackedCell::extract_value32(item), PackedCell::extract_clk16(item), ST_PUBLISHED, rel);
-            else
-                item = PackedCell::compose_clk48(PackedCell::extract_clk48(item), ST_PUBLISHED, rel);
-        }
+static inline Isa detect_isa() noexcept {
+#if ACS_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return Isa::AVX512;
+    if (__builtin_cpu_supports("avx2"))    return Isa::AVX2;
+    if (__builtin_cpu_supports("sse4.2"))  return Isa::SSE42;
+#endif
+    return Isa::SCALAR;
+}
 
-        size_t start = prod_cursor_.fetch_add(1, std::memory_order_relaxed);
-        size_t idx = start % capacity_;
-        int probes = 0;
-        while (true) {
-            packed64_t cur = raw_[idx].load(std::memory_order_acquire);
-            strel_t csr = PackedCell::extract_strel(cur);
-            if (PackedCell::st_from_strel(csr) == ST_IDLE) {
-                packed64_t expected = cur;
-                if (raw_[idx].compare_exchange_strong(expected, item, std::memory_order_acq_rel, std::memory_order_relaxed)) {
-                    size_t occ = occ_.fetch_add(1, std::memory_order_acq_rel) + 1;
-                    check_hw(occ);
-                    return idx;
-                }
-            }
-            ++probes;
-            if (max_probes >= 0 && probes >= max_probes) return SIZE_MAX;
-            if (probes >= static_cast<int>(capacity_)) return SIZE_MAX;
-            idx = (idx + 1) % capacity_;
-        }
+static inline MaskKernel kernel_for(Isa isa) noexcept {
+#if ACS_SCAN_X86
+    switch (isa) {
+    case Isa::AVX512: return &mask_avx512;
+    case Isa::AVX2:   return &mask_avx2;
+    case Isa::SSE42:  return &mask_sse42;
+    default: break;
     }
+#else
+    (void)isa;
+#endif
+    return &mask_scalar;
+}
 
-    // blocking publish with timeout (ms)
-    size_t publish_blocking(packed64_t item, int timeout_ms = -1) noexcept {
-        auto start = std::chrono::steady_clock::now();
-        while (true) {
-            size_t idx = publish(item, static_cast<int>(capacity_));
-            if (idx != SIZE_MAX) return idx;
-            if (timeout_ms == 0) return SIZE_MAX;
-            if (timeout_ms > 0) {
-                auto now = std::chrono::steady_clock::now();
-                if (std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count() >= timeout_ms) return SIZE_MAX;
-            }
-            std::this_thread::sleep_for(std::chrono::microseconds(50));
-        }
-    }
+inline Isa active_isa() noexcept {
+    static const Isa isa = detect_isa();
+    return isa;
+}
 
-    // consumer claim: try to claim any published slot whose rel matches rel_mask
-    bool claim_one(tag8_t rel_mask, size_t &out_idx, packed64_t &out_observed, int max_scans = -1) noexcept {
-        size_t start = hash_start(rel_mask);
-        size_t idx = start;
-        int scans = 0;
-        while (true) {
-            packed64_t cur = raw_[idx].load(std::memory_order_acquire);
-            strel_t csr = PackedCell::extract_strel(cur);
-            tag8_t st = PackedCell::st_from_strel(csr);
-            if (st == ST_PUBLISHED) {
-                tag8_t rel = PackedCell::rel_from_strel(csr);
-                if (rel_matches(rel, rel_mask)) {
-                    packed64_t desired = PackedCell::set_strel(cur, make_strel(ST_CLAIMED, rel));
-                    packed64_t exp = cur;
-                    if (raw_[idx].compare_exchange_strong(exp, desired, std::memory_order_acq_rel, std::memory_order_relaxed)) {
-                        out_idx = idx;
-                        out_observed = cur;
-                        return true;
-                    }
-                }
-            }
-            ++scans;
-            if (max_scans >= 0 && scans >= max_scans) return false;
-            if (scans >= static_cast<int>(capacity_)) return false;
-            idx = (idx + 1) % capacity_;
+inline MaskKernel active_kernel() noexcept {
+    static const MaskKernel k = kernel_for(active_isa());
+    return k;
+}
+
+// top-16 masks for the two predicates the containers use (same layout as extract_strel: st high, rel low)
+static inline constexpr packed64_t rel_bits(tag8_t rel_mask) noexcept { return packed64_t(rel_mask) << (64 - STRELB); }
+static inline constexpr packed64_t st_bits() noexcept { return packed64_t(0xFFu) << (64 - 8); }
+static inline constexpr packed64_t st_val(tag8_t st) noexcept { return packed64_t(st) << (64 - 8); }
+
+static inline const packed64_t* raw_view(const std::atomic<packed64_t>* a) noexcept {
+    static_assert(sizeof(std::atomic<packed64_t>) == sizeof(packed64_t), "atomic<packed64_t> must be layout compatible");
+    return reinterpret_cast<const packed64_t*>(a);
+}
+
+// Append runs [start, len) of cells in [begin, end) whose rel intersects rel_mask.
+// Runs are merged only with runs emitted by this call.
+inline void rel_ranges(const std::atomic<packed64_t>* data, size_t begin, size_t end, tag8_t rel_mask,
+                       std::vector<std::pair<size_t, size_t>> &out) noexcept {
+    const packed64_t* p = raw_view(data);
+    const packed64_t bits = rel_bits(rel_mask);
+    MaskKernel k = active_kernel();
+    size_t first_new = out.size();
+    for (size_t base = begin; base < end; base += 64) {
+        size_t n = std::min<size_t>(64, end - base);
+        uint64_t m = k(p + base, n, bits, 0, true);
+        while (m) {
+            unsigned s = static_cast<unsigned>(std::countr_zero(m));
+            uint64_t sh = m >> s;
+            unsigned len = (sh == ~uint64_t(0)) ? 64u - s : static_cast<unsigned>(std::countr_one(sh));
+            size_t at = base + s;
+            if (out.size() > first_new && out.back().first + out.back().second == at) out.back().second += len;
+            else out.emplace_back(at, len);
+            m = (s + len >= 64) ? 0 : (m & (~uint64_t(0) << (s + len)));
         }
     }
+    std::atomic_thread_fence(std::memory_order_acquire);
+}
 
-    // claim batch
-    size_t claim_batch(tag8_t rel_mask, std::vector<std::pair<size_t, packed64_t>> &out, size_t max_count) noexcept {
-        out.clear();
-        if (max_count == 0) return 0;
-        size_t start = hash_start(rel_mask);
-        size_t idx = start;
-        size_t scans = 0;
-        while (out.size() < max_count && scans < capacity_) {
-            packed64_t cur = raw_[idx].load(std::memory_order_acquire);
-            strel_t csr = PackedCell::extract_strel(cur);
-            if (PackedCell::st_from_strel(csr) == ST_PUBLISHED) {
-                tag8_t rel = PackedCell::rel_from_strel(csr);
-                if (rel_matches(rel, rel_mask)) {
-                    packed64_t desired = PackedCell::set_strel(cur, make_strel(ST_CLAIMED, rel));
-                    packed64_t expected = cur;
-                    if (raw_[idx].compare_exchange_strong(expected, desired, std::memory_order_acq_rel, std::memory_order_relaxed)) {
-                        out.emplace_back(idx, cur);
-                    }
-                }
-            }
-            ++scans;
-            idx = (idx + 1) % capacity_;
+// Append indices in [begin, end) whose state equals st.
+inline void st_indices(const std::atomic<packed64_t>* data, size_t begin, size_t end, tag8_t st,
+                       std::vector<size_t> &out) noexcept {
+    const packed64_t* p = raw_view(data);
+    MaskKernel k = active_kernel();
+    for (size_t base = begin; base < end; base += 64) {
+        size_t n = std::min<size_t>(64, end - base);
+        uint64_t m = k(p + base, n, st_bits(), st_val(st), false);
+        while (m) {
+            out.push_back(base + static_cast<size_t>(std::countr_zero(m)));
+            m &= m - 1;
         }
-        return out.size();
     }
+    std::atomic_thread_fence(std::memory_order_acquire);
+}
 
-    // commit: consumer writes final packed (will set COMPLETE if not set)
-    void commit_index(size_t idx, packed64_t committed) noexcept {
-        if (idx >= capacity_) return;
-        strel_t csr = PackedCell::extract_strel(committed);
-        tag8_t st = PackedCell::st_from_strel(csr);
-        tag8_t rel = PackedCell::rel_from_strel(csr);
-        if (st != ST_COMPLETE) {
-            if constexpr (MODE == PackedMode::MODE_VALUE32)
-                committed = PackedCell::compose_value32(PackedCell::extract_value32(committed), PackedCell::extract_clk16(committed), ST_COMPLETE, rel);
-            else
-                committed = PackedCell::compose_clk48(PackedCell::extract_clk48(committed), ST_COMPLETE, rel);
-        }
-        raw_[idx].store(committed, std::memory_order_release);
-        std::atomic_notify_all(&raw_[idx]);
+} // namespace PackedScan
+} // namespace AtomicCScompact
+#pragma once
+// FutexWait.hpp
+// Waiting layer for packed64_t cells. Futexes are 32-bit, so cells hash onto a table of
+// sequence-word buckets: notify(addr) bumps the bucket (only when someone waits) and wakes it;
+// waiters re-check their predicate against the cell, then sleep on the bucket word.
+// Linux: FUTEX_WAIT_BITSET with absolute CLOCK_MONOTONIC deadlines (no drift across spurious
+// wakeups) and futex_waitv for wait-any; other platforms poll with bounded backoff.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+
+#if defined(__linux__)
+    #include <cerrno>
+    #include <ctime>
+    #include <linux/futex.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+    #ifndef SYS_futex_waitv
+        #define SYS_futex_waitv 449
+    #endif
+#endif
+
+namespace AtomicCScompact {
+namespace FutexWait {
+
+static inline constexpr size_t BUCKETS = 256;   // power of two
+static inline constexpr size_t WAITV_MAX = 128; // kernel limit for futex_waitv
+
+struct alignas(64) Bucket {
+    std::atomic<uint32_t> seq{0};
+    std::atomic<uint32_t> waiters{0};
+};
+
+inline Bucket* table() noexcept {
+    static Bucket t[BUCKETS];
+    return t;
+}
+
+// extra bucket bumped on every notify while a fallback wait-any is parked
+inline Bucket& any_bucket() noexcept {
+    static Bucket b;
+    return b;
+}
+
+static inline Bucket& bucket_for(const void* addr) noexcept {
+    uint64_t k = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(addr)) >> 3;
+    k *= 11400714819323198485ull;
+    return table()[static_cast<size_t>(k >> 56) & (BUCKETS - 1)];
+}
+
+using Deadline = std::chrono::steady_clock::time_point;
+
+static inline Deadline deadline_after(int timeout_ms) noexcept {
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms < 0 ? 0 : timeout_ms);
+}
+
+#if defined(__linux__)
+static inline timespec to_timespec(Deadline d) noexcept {
+    // steady_clock is CLOCK_MONOTONIC on Linux
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d.time_since_epoch()).count();
+    if (ns < 0) ns = 0;
+    timespec ts;
+    ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+    ts.tv_nsec = static_cast<long>(ns % 1000000000);
+    return ts;
+}
+#endif
+
+// Sleep while *w == expected. has_deadline=false waits forever. Returns false only on timeout.
+// shared: word lives in memory mapped by several processes (no FUTEX_PRIVATE_FLAG).
+inline bool wait_word(std::atomic<uint32_t>* w, uint32_t expected, bool has_deadline, Deadline d, bool shared = false) noexcept {
+#if defined(__linux__)
+    timespec ts;
+    if (has_deadline) ts = to_timespec(d);
+    long rc = syscall(SYS_futex, reinterpret_cast<uint32_t*>(w), FUTEX_WAIT_BITSET | (shared ? 0 : FUTEX_PRIVATE_FLAG),
+                      expected, has_deadline ? &ts : nullptr, nullptr, FUTEX_BITSET_MATCH_ANY);
+    return !(rc == -1 && errno == ETIMEDOUT);
+#else
+    (void)shared;
+    auto pause = std::chrono::microseconds(1);
+    while (w->load(std::memory_order_acquire) == expected) {
+        if (has_deadline && std::chrono::steady_clock::now() >= d) return false;
+        std::this_thread::sleep_for(pause);
+        if (pause < std::chrono::microseconds(1000)) pause *= 2;
     }
+    return true;
+#endif
+}
 
-    // recycle by CPU: reset to IDLE and decrement occupancy
-    packed64_t recycle(size_t idx) noexcept {
-        if (idx >= capacity_) return packed64_t(0);
-        packed64_t prev = raw_[idx].load(std::memory_order_acquire);
-        raw_[idx].store(make_idle(), std::memory_order_release);
-        occ_.fetch_sub(1, std::memory_order_acq_rel);
-        return prev;
+inline void wake_word(std::atomic<uint32_t>* w, bool shared = false) noexcept {
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(w), FUTEX_WAKE | (shared ? 0 : FUTEX_PRIVATE_FLAG), INT32_MAX, nullptr, nullptr, 0);
+#else
+    (void)w;
+    (void)shared;
+#endif
+}
+
+#if defined(__linux__)
+inline std::atomic<int> &waitv_state() noexcept {
+    static std::atomic<int> ok{1};
+    return ok;
+}
+#endif
+
+inline bool waitv_supported() noexcept {
+#if defined(__linux__)
+    return waitv_state().load(std::memory_order_relaxed) != 0;
+#else
+    return false;
+#endif
+}
+
+// Sleep until any w[k] != expected[k] or a wake (n <= WAITV_MAX).
+// Returns 1 on wake/change, 0 on timeout, -1 when futex_waitv is unavailable.
+inline int wait_words_any(std::atomic<uint32_t>* const* w, const uint32_t* expected, size_t n, bool has_deadline, Deadline d) noexcept {
+    if (n == 1) return wait_word(w[0], expected[0], has_deadline, d) ? 1 : 0;
+#if defined(__linux__)
+    struct futex_waitv_ent { uint64_t val; uint64_t uaddr; uint32_t flags; uint32_t reserved; };
+    futex_waitv_ent ents[WAITV_MAX];
+    for (size_t j = 0; j < n; ++j) {
+        ents[j].val = expected[j];
+        ents[j].uaddr = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(w[j]));
+        ents[j].flags = 2u /*FUTEX2_SIZE_U32*/ | FUTEX_PRIVATE_FLAG;
+        ents[j].reserved = 0;
     }
+    timespec ts;
+    if (has_deadline) ts = to_timespec(d);
+    long rc = syscall(SYS_futex_waitv, ents, static_cast<unsigned>(n), 0u, has_deadline ? &ts : nullptr, CLOCK_MONOTONIC);
+    if (rc == -1 && errno == ENOSYS) { waitv_state().store(0, std::memory_order_relaxed); return -1; }
+    return (rc == -1 && errno == ETIMEDOUT) ? 0 : 1;
+#else
+    (void)w; (void)expected; (void)has_deadline; (void)d;
+    return -1;
+#endif
+}
 
-    // wait for change on slot
-    bool wait_slot_change(size_t idx, packed64_t expected, int timeout_ms = -1) const noexcept {
-        if (idx >= capacity_) return false;
-        if (timeout_ms < 0) {
-            std::atomic_wait(&raw_[idx], expected);
-            return true;
-        }
-        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
-        while (std::chrono::steady_clock::now() < deadline) {
-            packed64_t cur = raw_[idx].load(std::memory_order_acquire);
-            if (cur != expected) return true;
-            std::atomic_wait(&raw_[idx], expected);
-        }
-        return false;
+// Call after every store/CAS that waiters may care about.
+inline void notify(const void* addr) noexcept {
+    std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the waiter's registration RMW
+    Bucket &b = bucket_for(addr);
+    if (b.waiters.load(std::memory_order_relaxed) != 0) {
+        b.seq.fetch_add(1, std::memory_order_release);
+        wake_word(&b.seq);
+    }
+    Bucket &a = any_bucket();
+    if (a.waiters.load(std::memory_order_relaxed) != 0) {
+        a.seq.fetch_add(1, std::memory_order_release);
+        wake_word(&a.seq);
     }
+}
 
-    // debug scan
-    std::vector<size_t> find_state(tag8_t st_filter) const noexcept {
-        std::vector<size_t> v;
-        v.reserve(64);
-        for (size_t i = 0; i < capacity_; ++i) {
-            packed64_t p = raw_[i].load(std::memory_order_acquire);
-            tag8_t st = PackedCell::st_from_strel(PackedCell::extract_strel(p));
-            if (st == st_filter) v.push_back(i);
+// notify() for n consecutive cells: one fence, each bucket checked and woken at most once
+inline void notify_range(const std::atomic<packed64_t>* first, size_t n) noexcept {
+    if (n == 0) return;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool seen[BUCKETS] = {};
+    size_t left = BUCKETS;
+    for (size_t i = 0; i < n && left != 0; ++i) {
+        Bucket &b = bucket_for(first + i);
+        bool &s = seen[&b - table()];
+        if (s) continue;
+        s = true;
+        --left;
+        if (b.waiters.load(std::memory_order_relaxed) != 0) {
+            b.seq.fetch_add(1, std::memory_order_release);
+            wake_word(&b.seq);
         }
-        return v;
     }
-
-private:
-    inline packed64_t make_idle() const noexcept {
-        if constexpr (MODE == PackedMode::MODE_VALUE32)
-            return PackedCell::compose_value32(val32_t(0), clk16_t(0), ST_IDLE, tag8_t(0));
-        else
-            return PackedCell::compose_clk48(clk48_t(0), ST_IDLE, tag8_t(0));
+    Bucket &a = any_bucket();
+    if (a.waiters.load(std::memory_order_relaxed) != 0) {
+        a.seq.fetch_add(1, std::memory_order_release);
+        wake_word(&a.seq);
     }
+}
 
-    inline size_t hash_start(tag8_t rel_mask) const noexcept {
-        uint64_t key = static_cast<uint64_t>(rel_mask);
-        uint64_t mixed = key * HASH_CONST;
-        // compute bit width (C++20)
-        unsigned bw = std::bit_width(capacity_);
-        unsigned shift = (bw < 64) ? (64 - bw) : 0;
-        size_t idx = static_cast<size_t>(mixed >> shift);
-        if ((capacity_ & (capacity_ - 1)) != 0) idx %= capacity_;
-        return idx;
+struct WaiterGuard {
+    Bucket &b;
+    explicit WaiterGuard(Bucket &bk) noexcept : b(bk) { b.waiters.fetch_add(1, std::memory_order_seq_cst); }
+    ~WaiterGuard() { b.waiters.fetch_sub(1, std::memory_order_relaxed); }
+};
+
+// Wait until pred(cell value) holds. timeout_ms < 0 waits forever; 0 checks once.
+template<class Pred>
+bool wait_until(const std::atomic<packed64_t>* cell, Pred &&pred, int timeout_ms = -1) noexcept {
+    if (pred(cell->load(std::memory_order_acquire))) return true;
+    if (timeout_ms == 0) return false;
+    Bucket &b = bucket_for(cell);
+    WaiterGuard g(b);
+    const bool has_deadline = timeout_ms > 0;
+    const Deadline d = deadline_after(timeout_ms);
+    while (true) {
+        uint32_t s = b.seq.load(std::memory_order_acquire);
+        if (pred(cell->load(std::memory_order_acquire))) return true;
+        if (!wait_word(&b.seq, s, has_deadline, d)) return pred(cell->load(std::memory_order_acquire));
     }
+}
 
-    inline void check_hw(size_t occ) noexcept {
-        if (!cb_) return;
-        if (occ * 10 >= capacity_ * 8) cb_(occ, capacity_, cb_user_);
+// Wait until pred holds for any base[idxs[k]]; returns k, or SIZE_MAX on timeout.
+// Uses futex_waitv on the distinct buckets when the kernel has it (>= 5.16), else the any-bucket.
+template<class Pred>
+size_t wait_any(const std::atomic<packed64_t>* base, const size_t* idxs, size_t n, Pred &&pred, int timeout_ms = -1) noexcept {
+    auto probe = [&]() noexcept -> size_t {
+        for (size_t k = 0; k < n; ++k) if (pred(base[idxs[k]].load(std::memory_order_acquire))) return k;
+        return SIZE_MAX;
+    };
+    size_t hit = probe();
+    if (hit != SIZE_MAX || timeout_ms == 0 || n == 0) return hit;
+    const bool has_deadline = timeout_ms > 0;
+    const Deadline d = deadline_after(timeout_ms);
+
+    Bucket* bk[WAITV_MAX];
+    size_t nb = 0;
+    bool fits = true; // more distinct buckets than the kernel accepts: use the any-bucket path
+    for (size_t k = 0; k < n && fits; ++k) {
+        Bucket* b = &bucket_for(&base[idxs[k]]);
+        size_t j = 0;
+        while (j < nb && bk[j] != b) ++j;
+        if (j < nb) continue;
+        if (nb == WAITV_MAX) fits = false;
+        else bk[nb++] = b;
+    }
+    if (fits && (nb == 1 || waitv_supported())) {
+        std::atomic<uint32_t>* words[WAITV_MAX];
+        uint32_t expect[WAITV_MAX];
+        for (size_t j = 0; j < nb; ++j) { bk[j]->waiters.fetch_add(1, std::memory_order_seq_cst); words[j] = &bk[j]->seq; }
+        size_t result = SIZE_MAX;
+        int rc = 1;
+        while (true) {
+            for (size_t j = 0; j < nb; ++j) expect[j] = words[j]->load(std::memory_order_acquire);
+            result = probe();
+            if (result != SIZE_MAX) break;
+            rc = wait_words_any(words, expect, nb, has_deadline, d);
+            if (rc <= 0) break;
+        }
+        for (size_t j = 0; j < nb; ++j) bk[j]->waiters.fetch_sub(1, std::memory_order_relaxed);
+        if (rc == 0) return probe();
+        if (rc > 0) return result;
     }
 
-    std::atomic<packed64_t>* raw_{nullptr};
-    size_t capacity_{0};
-    std::atomic<size_t> occ_{0};
-    std::atomic<size_t> prod_cursor_{0};
-    std::atomic<size_t> cons_cursor_{0};
-    HWCallback cb_{nullptr};
-    void* cb_user_{nullptr};
-    int node_{0};
-};
+    Bucket &a = any_bucket();
+    WaiterGuard g(a);
+    while (true) {
+        uint32_t s = a.seq.load(std::memory_order_acquire);
+        size_t r = probe();
+        if (r != SIZE_MAX) return r;
+        if (!wait_word(&a.seq, s, has_deadline, d)) return probe();
+    }
+}
 
+} // namespace FutexWait
 } // namespace AtomicCScompact
 #pragma once
-// AtomicPCArray.hpp
-// Single-array-of-64bit-atomics. Exposes auto pack/unpack helpers and
-// a page/region relation index to look up ranges quickly by relation bitmask.
+// WaitStrategy.hpp
+// Compile-time wait/backoff policies shared by every blocking path of the containers.
+//   BusySpinWait  : pause instruction only (lowest latency, burns a core)
+//   SpinYieldWait : short pause spin, then sched_yield
+//   BackoffWait   : short pause spin, then exponential sleep 1us..1ms
+//   ParkWait      : sleep on futex eventcounts / FutexWait buckets (default)
+// A policy provides `parks` and `pause(round)`; WaitOps turns it into cell waits and retry loops.
 
 #include <atomic>
-#include <vector>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
-#include <stdexcept>
-#include <functional>
+#include <thread>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #include <immintrin.h>
+#endif
 
-#include "PackedCell.hpp"
-#include "PackedStRel.h"
-#include "AllocNW.hpp"
 
 namespace AtomicCScompact {
 
-template<PackedMode MODE>
-class AtomicPCArray {
-public:
-    using packed_t = packed64_t;
-    AtomicPCArray() noexcept : n_(0), meta_(nullptr), owned_bytes_(0), region_size_(0) {}
-    ~AtomicPCArray() { free_all(); }
+static inline void cpu_relax() noexcept {
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    _mm_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
 
-    void init_on_node(size_t n, int node, size_t alignment = 64) {
-        free_all();
-        if (n == 0) throw std::invalid_argument("n==0");
-        std::atomic<packed_t> test{0};
-        if (!test.is_lock_free()) throw std::runtime_error("atomic<packed_t> not lock-free");
-        n_ = n;
-        owned_bytes_ = sizeof(std::atomic<packed_t>) * n_;
-        void* p = AllocNW::AlignedAllocONnode(alignment, owned_bytes_, node);
-        meta_ = reinterpret_cast<std::atomic<packed_t>*>(p);
-        for (size_t i = 0; i < n_; ++i) new (&meta_[i]) std::atomic<packed_t>(make_idle());
+struct BusySpinWait {
+    static constexpr bool parks = false;
+    static inline void pause(unsigned) noexcept { cpu_relax(); }
+};
+
+struct SpinYieldWait {
+    static constexpr bool parks = false;
+    static inline void pause(unsigned round) noexcept {
+        if (round < 64) cpu_relax();
+        else std::this_thread::yield();
     }
+};
 
-    void init_from_existing(std::atomic<packed_t>* backing, size_t n) {
-        free_all();
-        if (!backing) throw std::invalid_argument("backing==nullptr");
-        n_ = n;
-        meta_ = backing;
-        owned_bytes_ = 0;
+struct BackoffWait {
+    static constexpr bool parks = false;
+    static inline void pause(unsigned round) noexcept {
+        if (round < 16) { cpu_relax(); return; }
+        unsigned k = round - 16 < 10 ? round - 16 : 10;
+        std::this_thread::sleep_for(std::chrono::microseconds(1u << k));
     }
+};
 
-    void free_all() noexcept {
-        if (meta_) {
-            for (size_t i = 0; i < n_; ++i) meta_[i].~atomic();
-            if (owned_bytes_ != 0) AllocNW::FreeONNode(static_cast<void*>(meta_), owned_bytes_);
-            meta_ = nullptr;
-        }
-        n_ = 0;
-        owned_bytes_ = 0;
-        region_size_ = 0;
-        region_rel_.clear();
+// pause() is only used where no eventcount exists (e.g. waiting out a short ST_PENDING window)
+struct ParkWait {
+    static constexpr bool parks = true;
+    static inline void pause(unsigned round) noexcept {
+        if (round < 64) cpu_relax();
+        else std::this_thread::yield();
     }
+};
 
-    size_t size() const noexcept { return n_; }
+// Futex eventcount: prepare() -> re-check condition -> wait(key) or cancel().
+// SHARED: the eventcount sits in memory mapped by several processes (process-shared futex)
+template<bool SHARED>
+struct alignas(64) BasicEventCount {
+    std::atomic<uint32_t> epoch{0};
+    std::atomic<uint32_t> waiters{0};
 
-    // read / store helpers
-    packed_t load(size_t idx, std::memory_order mo = std::memory_order_acquire) const noexcept {
-        if (idx >= n_) return packed_t(0);
-        return meta_[idx].load(mo);
+    inline uint32_t prepare() noexcept {
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        return epoch.load(std::memory_order_acquire);
     }
-    void store(size_t idx, packed_t v, std::memory_order mo = std::memory_order_release) noexcept {
-        if (idx >= n_) return;
-        meta_[idx].store(v, mo);
-        std::atomic_notify_all(&meta_[idx]);
+    inline void cancel() noexcept { waiters.fetch_sub(1, std::memory_order_relaxed); }
+    // false on timeout; caller still calls cancel()
+    inline bool wait(uint32_t key, bool has_deadline, FutexWait::Deadline d) noexcept {
+        return FutexWait::wait_word(&epoch, key, has_deadline, d, SHARED);
     }
-    bool compare_exchange(size_t idx, packed_t &expected, packed_t desired) noexcept {
+    // caller has already issued the seq_cst fence that pairs with prepare()
+    inline void notify_fenced() noexcept {
+        if (waiters.load(std::memory_order_relaxed) == 0) return;
+        epoch.fetch_add(1, std::memory_order_release);
+        FutexWait::wake_word(&epoch, SHARED);
+    }
+    inline void notify() noexcept {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        notify_fenced();
+    }
+    // no fence: the caller's condition write was a seq_cst RMW that the waiter re-checks with a
+    // seq_cst load after prepare(), so one of the two sides always sees the other
+    inline void notify_after_rmw() noexcept {
+        if (waiters.load(std::memory_order_seq_cst) == 0) return;
+        epoch.fetch_add(1, std::memory_order_release);
+        FutexWait::wake_word(&epoch, SHARED);
+    }
+};
+
+using EventCount = BasicEventCount<false>;
+using SharedEventCount = BasicEventCount<true>;
+
+namespace WaitOps {
+
+// wait until pred(cell) holds; timeout_ms < 0 waits forever, 0 checks once
+template<class W, class Pred>
+bool until(const std::atomic<packed64_t>* cell, Pred &&pred, int timeout_ms) noexcept {
+    if constexpr (W::parks) {
+        return FutexWait::wait_until(cell, pred, timeout_ms);
+    } else {
+        if (pred(cell->load(std::memory_order_acquire))) return true;
+        if (timeout_ms == 0) return false;
+        const FutexWait::Deadline d = FutexWait::deadline_after(timeout_ms);
+        for (unsigned round = 0;; ++round) {
+            if (pred(cell->load(std::memory_order_acquire))) return true;
+            if (timeout_ms > 0 && std::chrono::steady_clock::now() >= d) return false;
+            W::pause(round);
+        }
+    }
+}
+
+// wait until pred holds for any base[idxs[k]]; returns k or SIZE_MAX on timeout
+template<class W, class Pred>
+size_t any(const std::atomic<packed64_t>* base, const size_t* idxs, size_t n, Pred &&pred, int timeout_ms) noexcept {
+    if constexpr (W::parks) {
+        return FutexWait::wait_any(base, idxs, n, pred, timeout_ms);
+    } else {
+        const FutexWait::Deadline d = FutexWait::deadline_after(timeout_ms);
+        for (unsigned round = 0;; ++round) {
+            for (size_t k = 0; k < n; ++k) if (pred(base[idxs[k]].load(std::memory_order_acquire))) return k;
+            if (timeout_ms == 0 || (timeout_ms > 0 && std::chrono::steady_clock::now() >= d)) return SIZE_MAX;
+            W::pause(round);
+        }
+    }
+}
+
+// retry attempt() until it succeeds or times out; parking policies sleep on ec between attempts
+template<class W, class Try, class EC = EventCount>
+bool retry(Try &&attempt, int timeout_ms, EC* ec = nullptr) noexcept {
+    if (attempt()) return true;
+    if (timeout_ms == 0) return false;
+    const bool has_deadline = timeout_ms > 0;
+    const FutexWait::Deadline d = FutexWait::deadline_after(timeout_ms);
+    for (unsigned round = 0;; ++round) {
+        if constexpr (W::parks) {
+            if (ec) {
+                uint32_t key = ec->prepare();
+                if (attempt()) { ec->cancel(); return true; }
+                bool woke = ec->wait(key, has_deadline, d);
+                ec->cancel();
+                if (!woke) return attempt();
+                if (attempt()) return true;
+                continue;
+            }
+        }
+        if (has_deadline && std::chrono::steady_clock::now() >= d) return attempt();
+        W::pause(round);
+        if (attempt()) return true;
+    }
+}
+
+} // namespace WaitOps
+} // namespace AtomicCScompact
+#pragma once
+// HotPathStats.hpp
+// Compile-time optional contention counters for the containers' hot paths.
+//   NoStats         : default; every hook is an empty inline call, so the build is unchanged
+//   ContentionStats : per-thread padded counter stripes plus a CAS-failure heatmap
+// Containers take the policy as a template parameter and expose stats() snapshots.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace AtomicCScompact {
+
+struct NoStats         { static constexpr bool enabled = false; };
+struct ContentionStats { static constexpr bool enabled = true; };
+
+enum StatCounter : unsigned {
+    STAT_CAS_FAIL = 0,    // lost CAS on a slot/cell or cursor
+    STAT_PUBLISH_CALLS,
+    STAT_PUBLISH_PROBES,  // slots inspected by publish/publish_batch
+    STAT_CLAIM_CALLS,
+    STAT_CLAIM_SCANS,     // slots inspected by claim_one/claim_batch
+    STAT_BLOCK_ROUNDS,    // failed attempts inside publish_blocking
+    STAT_HW_HITS,         // high-water callback invocations
+    STAT_COUNT
+};
+
+struct StatsSnapshot {
+    uint64_t counters[STAT_COUNT] = {};
+    std::vector<uint64_t> heat; // CAS failures per index range (capacity / heat.size() cells each)
+    uint64_t operator[](StatCounter c) const noexcept { return counters[c]; }
+};
+
+// per-thread striping shared by the padded counters: threads take stripes round-robin on first use
+static inline constexpr size_t THREAD_STRIPES = 32;
+
+static inline size_t thread_stripe() noexcept {
+    static std::atomic<size_t> next{0};
+    thread_local size_t mine = next.fetch_add(1, std::memory_order_relaxed) & (THREAD_STRIPES - 1);
+    return mine;
+}
+
+template<bool ENABLED>
+class HotPathStats {
+public:
+    void init(size_t) noexcept {}
+    inline void add(StatCounter, uint64_t = 1) noexcept {}
+    inline void cas_fail(size_t) noexcept {}
+    StatsSnapshot snapshot() const { return {}; }
+    void reset() noexcept {}
+};
+
+template<>
+class HotPathStats<true> {
+public:
+    static inline constexpr size_t STRIPES = THREAD_STRIPES;
+    static inline constexpr size_t HEAT_BUCKETS = 64;
+
+    // cells: index space the heatmap covers
+    void init(size_t cells) noexcept {
+        span_ = cells / HEAT_BUCKETS + 1;
+        reset();
+    }
+
+    inline void add(StatCounter c, uint64_t n = 1) noexcept {
+        stripes_[thread_stripe()].c[c].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    inline void cas_fail(size_t idx) noexcept {
+        add(STAT_CAS_FAIL);
+        heat_[std::min(idx / span_, HEAT_BUCKETS - 1)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // relaxed sums: consistent per counter, not across counters
+    StatsSnapshot snapshot() const {
+        StatsSnapshot s;
+        for (auto &st : stripes_)
+            for (unsigned c = 0; c < STAT_COUNT; ++c) s.counters[c] += st.c[c].load(std::memory_order_relaxed);
+        s.heat.resize(HEAT_BUCKETS);
+        for (size_t i = 0; i < HEAT_BUCKETS; ++i) s.heat[i] = heat_[i].load(std::memory_order_relaxed);
+        return s;
+    }
+
+    void reset() noexcept {
+        for (auto &st : stripes_)
+            for (auto &c : st.c) c.store(0, std::memory_order_relaxed);
+        for (auto &h : heat_) h.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    struct alignas(64) Stripe { std::atomic<uint64_t> c[STAT_COUNT]; };
+
+    Stripe stripes_[STRIPES]{};
+    std::atomic<uint64_t> heat_[HEAT_BUCKETS]{};
+    size_t span_{1};
+};
+
+} // namespace AtomicCScompact
+#pragma once
+// PayloadArray.hpp
+// Typed side table for payloads too large for a packed cell: payload i belongs to cell i of a
+// mailbox or AtomicPCArray of the same size, allocated on the same node. The cell is the guard:
+// whoever holds it owns payload i (producer between reserve and publish_reserved, consumer
+// between claim and recycle, writer between reserve_for_update and commit_update), and the
+// release/acquire on the cell orders the payload accesses. No locks, and readers use the
+// payload in place. Readers that do not hold the cell validate against its word instead
+// (AtomicPCArray::read_payload).
+
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include "AllocNW.hpp"
+
+namespace AtomicCScompact {
+
+template<class T>
+class PayloadArray {
+public:
+    static_assert(std::is_default_constructible_v<T>, "PayloadArray<T> needs a default-constructible T");
+
+    PayloadArray() noexcept = default;
+    PayloadArray(size_t n, int node = 0) { init_on_node(n, node); }
+    ~PayloadArray() { release(); }
+
+    PayloadArray(const PayloadArray&) = delete;
+    PayloadArray& operator=(const PayloadArray&) = delete;
+
+    void init_on_node(size_t n, int node = 0) {
+        AllocNW::AllocOptions opt;
+        opt.node = node;
+        init_on_node(n, opt);
+    }
+
+    // trivially default-constructible T is used straight from the allocator's zero pages
+    void init_on_node(size_t n, const AllocNW::AllocOptions &opt) {
+        release();
+        if (n == 0) throw std::invalid_argument("n==0");
+        opt_ = opt;
+        data_ = static_cast<T*>(AllocNW::Alloc(sizeof(T) * n, opt_, ALIGN));
+        n_ = n;
+        if constexpr (!std::is_trivially_default_constructible_v<T>) {
+            size_t i = 0;
+            try {
+                for (; i < n_; ++i) new (&data_[i]) T();
+            } catch (...) {
+                destroy(i);
+                throw;
+            }
+        }
+    }
+
+    void release() noexcept {
+        if (!data_) return;
+        destroy(n_);
+        n_ = 0;
+    }
+
+    size_t size() const noexcept { return n_; }
+    T* data() noexcept { return data_; }
+    const T* data() const noexcept { return data_; }
+    T& operator[](size_t i) noexcept { return data_[i]; }
+    const T& operator[](size_t i) const noexcept { return data_[i]; }
+
+private:
+    static inline constexpr size_t ALIGN = alignof(T) > 64 ? alignof(T) : 64;
+
+    void destroy(size_t constructed) noexcept {
+        if constexpr (!std::is_trivially_destructible_v<T>)
+            for (size_t i = 0; i < constructed; ++i) data_[i].~T();
+        AllocNW::Free(data_, sizeof(T) * n_, opt_, ALIGN);
+        data_ = nullptr;
+    }
+
+    T* data_{nullptr};
+    size_t n_{0};
+    AllocNW::AllocOptions opt_{};
+};
+
+} // namespace AtomicCScompact
+#pragma once
+// DualRailArray.hpp
+// Value / Inverse / State|Relation planes (DOCS/ProjPlan.odt) as structure-of-arrays: V[i]
+// holds value32, Inv[i] holds ~value32 and meta[i] the st|rel pair plus a write version.
+// Outside a write V[i] == ~Inv[i] always holds, so any other pattern is in-memory corruption:
+// a flipped bit, a zeroed page (both rails 0) or a stray write to one plane. verify() sweeps
+// both rails with SIMD kernels that OR ~(V ^ Inv) over 64 cells per step, so a clean region
+// costs one pass at memory bandwidth; only a block with a bad lane is re-checked cell by cell,
+// under the cell's version, so writes in flight are never reported.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "AllocNW.hpp"
+
+namespace AtomicCScompact {
+namespace DualRail {
+
+// index of the first i in [0, n) with v[i] != ~inv[i], or n
+using FindKernel = size_t(*)(const uint32_t* v, const uint32_t* inv, size_t n);
+
+static inline constexpr size_t BLOCK = 64; // cells OR-reduced before one branch
+
+static inline size_t find_scalar(const uint32_t* v, const uint32_t* inv, size_t n) noexcept {
+    size_t i = 0;
+    for (; i + BLOCK <= n; i += BLOCK) {
+        uint32_t acc = 0;
+        for (size_t k = 0; k < BLOCK; ++k) acc |= ~(v[i + k] ^ inv[i + k]);
+        if (acc) break;
+    }
+    for (; i < n; ++i) if ((v[i] ^ inv[i]) != ~uint32_t(0)) return i;
+    return n;
+}
+
+#if ACS_SCAN_X86
+__attribute__((target("sse4.2")))
+static inline size_t find_sse42(const uint32_t* v, const uint32_t* inv, size_t n) noexcept {
+    const __m128i ones = _mm_set1_epi32(-1);
+    size_t i = 0;
+    for (; i + BLOCK <= n; i += BLOCK) {
+        __m128i acc = _mm_setzero_si128();
+        for (size_t k = 0; k < BLOCK; k += 4) {
+            __m128i x = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i + k)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(inv + i + k)));
+            acc = _mm_or_si128(acc, _mm_xor_si128(x, ones));
+        }
+        if (!_mm_testz_si128(acc, acc)) break;
+    }
+    return i + find_scalar(v + i, inv + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline size_t find_avx2(const uint32_t* v, const uint32_t* inv, size_t n) noexcept {
+    const __m256i ones = _mm256_set1_epi32(-1);
+    size_t i = 0;
+    for (; i + BLOCK <= n; i += BLOCK) {
+        __m256i acc = _mm256_setzero_si256();
+        for (size_t k = 0; k < BLOCK; k += 8) {
+            __m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i + k)),
+                                         _mm256_loadu_si256(reinterpret_cast<const __m256i*>(inv + i + k)));
+            acc = _mm256_or_si256(acc, _mm256_xor_si256(x, ones));
+        }
+        if (!_mm256_testz_si256(acc, acc)) break;
+    }
+    return i + find_scalar(v + i, inv + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+static inline size_t find_avx512(const uint32_t* v, const uint32_t* inv, size_t n) noexcept {
+    size_t i = 0;
+    for (; i + BLOCK <= n; i += BLOCK) {
+        __m512i acc = _mm512_setzero_si512();
+        for (size_t k = 0; k < BLOCK; k += 16) // acc |= ~(v ^ inv) in one ternary op (0xEB)
+            acc = _mm512_ternarylogic_epi32(_mm512_loadu_si512(v + i + k), _mm512_loadu_si512(inv + i + k), acc, 0xEB);
+        if (_mm512_test_epi32_mask(acc, acc)) break;
+    }
+    return i + find_scalar(v + i, inv + i, n - i);
+}
+#endif
+
+static inline FindKernel find_kernel_for(PackedScan::Isa isa) noexcept {
+#if ACS_SCAN_X86
+    switch (isa) {
+    case PackedScan::Isa::AVX512: return &find_avx512;
+    case PackedScan::Isa::AVX2:   return &find_avx2;
+    case PackedScan::Isa::SSE42:  return &find_sse42;
+    default: break;
+    }
+#else
+    (void)isa;
+#endif
+    return &find_scalar;
+}
+
+inline FindKernel active_kernel() noexcept {
+    static const FindKernel k = find_kernel_for(PackedScan::active_isa());
+    return k;
+}
+
+} // namespace DualRail
+
+// WAIT: how load() and verify() wait out a write in flight on one cell (see WaitStrategy.hpp)
+template<class WAIT = ParkWait>
+class DualRailArray {
+public:
+    DualRailArray() noexcept = default;
+    explicit DualRailArray(size_t n, int node = 0) { init_on_node(n, node); }
+    ~DualRailArray() { free_all(); }
+
+    DualRailArray(const DualRailArray&) = delete;
+    DualRailArray& operator=(const DualRailArray&) = delete;
+
+    void init_on_node(size_t n, int node = 0) {
+        AllocNW::AllocOptions opt;
+        opt.node = node;
+        init_on_node(n, opt);
+    }
+
+    // the three planes share one allocation. Value and meta planes come up zero; the inverse
+    // plane is filled with ~0 (every cell holds value 0) by workers pinned to opt.node.
+    void init_on_node(size_t n, const AllocNW::AllocOptions &opt) {
+        free_all();
+        if (n == 0) throw std::invalid_argument("n==0");
+        const size_t plane = (n * sizeof(uint32_t) + 63) & ~size_t(63);
+        void* p = AllocNW::Alloc(3 * plane, opt, 64);
+        alloc_ = opt;
+        bytes_ = 3 * plane;
+        n_ = n;
+        value_ = static_cast<std::atomic<uint32_t>*>(p);
+        inverse_ = reinterpret_cast<std::atomic<uint32_t>*>(static_cast<char*>(p) + plane);
+        meta_ = reinterpret_cast<std::atomic<uint32_t>*>(static_cast<char*>(p) + 2 * plane);
+        uint32_t* inv = const_cast<uint32_t*>(raw(inverse_));
+        for_ranges(0, n_, worker_count(n_, 0), [inv](size_t, size_t b, size_t e) {
+            std::memset(inv + b, 0xFF, (e - b) * sizeof(uint32_t));
+        });
+    }
+
+    void free_all() noexcept {
+        if (value_) AllocNW::Free(static_cast<void*>(value_), bytes_, alloc_, 64);
+        value_ = inverse_ = meta_ = nullptr;
+        n_ = 0;
+        bytes_ = 0;
+    }
+
+    size_t size() const noexcept { return n_; }
+
+    // store: value, its inverse and st/rel as one write (per-cell seqlock; writers of one cell
+    // take turns on the version)
+    void store(size_t idx, val32_t v, tag8_t st, tag8_t rel) noexcept {
+        if (idx >= n_) return;
+        std::atomic<uint32_t> &m = meta_[idx];
+        uint32_t cur = m.load(std::memory_order_relaxed);
+        for (unsigned round = 0;; ++round) {
+            if (cur & 1u) {
+                WAIT::pause(round);
+                cur = m.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (m.compare_exchange_weak(cur, cur + 1, std::memory_order_acquire, std::memory_order_relaxed)) break;
+        }
+        std::atomic_thread_fence(std::memory_order_release); // a reader that sees a rail sees the odd version
+        value_[idx].store(v, std::memory_order_relaxed);
+        inverse_[idx].store(~v, std::memory_order_relaxed);
+        m.store(static_cast<uint32_t>(make_strel(st, rel)) << 16 | ((cur + 2) & 0xFFFFu), std::memory_order_release);
+    }
+
+    // load: value and st/rel of idx; false if idx is out of range or its rails disagree
+    bool load(size_t idx, val32_t &v, tag8_t &st, tag8_t &rel) const noexcept {
+        if (idx >= n_) return false;
+        uint32_t a, b, m;
+        for (unsigned round = 0; !read_cell(idx, a, b, m); ++round) WAIT::pause(round);
+        if ((a ^ b) != ~uint32_t(0)) return false;
+        v = a;
+        st = PackedCell::st_from_strel(static_cast<strel_t>(m >> 16));
+        rel = PackedCell::rel_from_strel(static_cast<strel_t>(m >> 16));
+        return true;
+    }
+
+    // verify: sweep [begin, end) and append the indices whose rails disagree outside a write,
+    // at most max_report of them; returns how many were found. Runs beside writers.
+    size_t verify(size_t begin, size_t end, std::vector<size_t> &corrupt, size_t max_report = SIZE_MAX) const {
+        end = std::min(end, n_);
+        const uint32_t* v = raw(value_);
+        const uint32_t* inv = raw(inverse_);
+        DualRail::FindKernel k = DualRail::active_kernel();
+        size_t found = 0;
+        for (size_t i = begin; i < end;) {
+            const size_t at = i + k(v + i, inv + i, end - i);
+            if (at >= end) break;
+            if (confirm(at)) {
+                if (found < max_report) corrupt.push_back(at);
+                ++found;
+            }
+            i = at + 1;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return found;
+    }
+
+    // verify_all: verify() over the whole array from `threads` workers (0 = one per CPU) pinned
+    // to the array's node; corrupt comes back sorted. One sweep reads 8 bytes per cell.
+    size_t verify_all(std::vector<size_t> &corrupt, unsigned threads = 0, size_t max_report = SIZE_MAX) const {
+        const size_t workers = worker_count(n_, threads);
+        std::vector<std::vector<size_t>> parts(workers);
+        std::vector<size_t> counts(workers, 0);
+        for_ranges(0, n_, workers, [&](size_t w, size_t b, size_t e) { counts[w] = verify(b, e, parts[w], max_report); });
+        size_t found = 0;
+        for (size_t w = 0; w < workers; ++w) {
+            found += counts[w];
+            for (size_t i = 0; i < parts[w].size() && corrupt.size() < max_report; ++i) corrupt.push_back(parts[w][i]);
+        }
+        return found;
+    }
+
+    // raw planes (DMA, external checkers); writes must go through store()
+    const uint32_t* value_plane() const noexcept { return raw(value_); }
+    const uint32_t* inverse_plane() const noexcept { return raw(inverse_); }
+
+private:
+    static inline constexpr unsigned CONFIRM_ROUNDS = 256;
+
+    static inline const uint32_t* raw(const std::atomic<uint32_t>* a) noexcept {
+        static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "atomic<uint32_t> must be layout compatible");
+        return reinterpret_cast<const uint32_t*>(a);
+    }
+
+    // one consistent read of both rails and meta; false while a write is in flight
+    bool read_cell(size_t idx, uint32_t &v, uint32_t &inv, uint32_t &m) const noexcept {
+        m = meta_[idx].load(std::memory_order_acquire);
+        if (m & 1u) return false;
+        v = value_[idx].load(std::memory_order_relaxed);
+        inv = inverse_[idx].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return meta_[idx].load(std::memory_order_relaxed) == m;
+    }
+
+    // a sweep hit: corrupt only if the rails still disagree in a quiet read. A cell that keeps
+    // changing is left to the next sweep.
+    bool confirm(size_t idx) const noexcept {
+        uint32_t v, inv, m;
+        for (unsigned round = 0; round < CONFIRM_ROUNDS; ++round) {
+            if (read_cell(idx, v, inv, m)) return (v ^ inv) != ~uint32_t(0);
+            WAIT::pause(round);
+        }
+        return false;
+    }
+
+    // a worker per 4M cells (16 MiB of each plane) at most; below that the spawn costs more
+    static size_t worker_count(size_t cells, unsigned threads) noexcept {
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        const size_t min_cells = size_t(4) << 20;
+        return std::max<size_t>(1, std::min<size_t>(threads, (cells + min_cells - 1) / min_cells));
+    }
+
+    // f(w, b, e) on `workers` contiguous runs of [begin, end) (whole BLOCKs), workers 1.. on
+    // threads pinned to the array's node, worker 0 on the caller
+    template<class F>
+    void for_ranges(size_t begin, size_t end, size_t workers, F &&f) const {
+        if (begin >= end) return;
+        const size_t per = ((end - begin + workers - 1) / workers + DualRail::BLOCK - 1) & ~(DualRail::BLOCK - 1);
+        const int node = alloc_.node;
+        auto run = [&](size_t w, bool pin) {
+            const size_t b = begin + w * per, e = std::min(end, b + per);
+        #if defined(HAVE_LIBNUMA)
+            if (pin && node >= 0 && numa_available() >= 0) numa_run_on_node(node);
+        #else
+            (void)pin; (void)node;
+        #endif
+            if (b < e) f(w, b, e);
+        };
+        std::vector<std::thread> pool;
+        pool.reserve(workers - 1);
+        for (size_t w = 1; w < workers; ++w) {
+            try { pool.emplace_back(run, w, true); }
+            catch (...) { run(w, false); }
+        }
+        run(0, false);
+        for (auto &t : pool) t.join();
+    }
+
+    std::atomic<uint32_t>* value_{nullptr};
+    std::atomic<uint32_t>* inverse_{nullptr};
+    std::atomic<uint32_t>* meta_{nullptr}; // st|rel << 16 | version (odd while a write is in flight)
+    size_t n_{0};
+    size_t bytes_{0};
+    AllocNW::AllocOptions alloc_{};
+};
+
+} // namespace AtomicCScompact
+#pragma once
+// MPMCArrayPacked.hpp
+// Slot-array mailbox specialized for packed64_t (PackedCell).
+// The array is NUMA-allocated via AllocNW::Alloc (MailboxOptions::alloc picks the
+// page size / policy; strict single-node base pages by default, small arrays from the node arena).
+// Designed for CPU<->GPU mailbox usage: consumers scan slots and claim by rel mask.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <bit>
+#include <cassert>
+#include <span>
+#include <algorithm>
+
+#include "AllocNW.hpp"
+
+namespace AtomicCScompact {
+
+using packed64_t = ::AtomicCScompact::packed64_t;
+using tag8_t     = ::AtomicCScompact::tag8_t;
+using strel_t    = ::AtomicCScompact::strel_t;
+using PackedMode = ::AtomicCScompact::PackedMode;
+
+using HWCallback = void(*)(size_t current, size_t capacity, void* user);
+
+static inline constexpr uint64_t HASH_CONST = 11400714819323198485ull;
+
+// Two-level summary of ST_PUBLISHED slots: one leaf bit per slot, one summary bit per
+// non-empty 64-slot leaf word. Bits are hints kept in sync by the owning container:
+// a set bit may be stale, but a published slot is never left without its bit.
+class PublishedBitmap {
+public:
+    PublishedBitmap() noexcept = default;
+    ~PublishedBitmap() { release(); }
+
+    PublishedBitmap(const PublishedBitmap&) = delete;
+    PublishedBitmap& operator=(const PublishedBitmap&) = delete;
+
+    void init(size_t slots, int node) {
+        release();
+        n_leaf_ = (slots + 63) / 64;
+        n_sum_  = (n_leaf_ + 63) / 64;
+        node_ = node;
+        leaf_ = alloc_words(n_leaf_, node);
+        sum_  = alloc_words(n_sum_, node);
+    }
+
+    void release() noexcept {
+        free_words(leaf_, n_leaf_, node_);
+        free_words(sum_, n_sum_, node_);
+        leaf_ = sum_ = nullptr;
+        n_leaf_ = n_sum_ = 0;
+    }
+
+    bool enabled() const noexcept { return leaf_ != nullptr; }
+
+    inline void set(size_t idx) noexcept {
+        size_t li = idx >> 6;
+        uint64_t b = uint64_t(1) << (idx & 63);
+        if (leaf_[li].fetch_or(b) == 0) sum_[li >> 6].fetch_or(uint64_t(1) << (li & 63));
+    }
+
+    inline void clear(size_t idx) noexcept {
+        size_t li = idx >> 6;
+        uint64_t b = uint64_t(1) << (idx & 63);
+        if (leaf_[li].fetch_and(~b) != b) return;
+        // leaf went empty: drop the summary bit, then re-arm it if a publisher raced in
+        uint64_t sb = uint64_t(1) << (li & 63);
+        sum_[li >> 6].fetch_and(~sb);
+        if (leaf_[li].load() != 0) sum_[li >> 6].fetch_or(sb);
+    }
+
+    // Visit candidate slot indices (< limit), starting at the leaf holding `start` and wrapping.
+    // f(idx) returns true to stop; returns true if stopped early.
+    template<class F>
+    bool for_each_from(size_t start, size_t limit, F &&f) const noexcept {
+        if (n_leaf_ == 0) return false;
+        size_t l0 = (start >> 6) % n_leaf_;
+        size_t s0 = l0 >> 6;
+        for (size_t k = 0; k <= n_sum_; ++k) {
+            size_t si = (s0 + k) % n_sum_;
+            uint64_t w = sum_[si].load(std::memory_order_acquire);
+            if (k == 0) w &= ~uint64_t(0) << (l0 & 63);              // first pass: leaves >= l0
+            else if (k == n_sum_) w &= ~(~uint64_t(0) << (l0 & 63)); // wrap: leaves < l0
+            while (w) {
+                size_t li = (si << 6) + static_cast<size_t>(std::countr_zero(w));
+                w &= w - 1;
+                uint64_t lw = leaf_[li].load(std::memory_order_acquire);
+                while (lw) {
+                    size_t idx = (li << 6) + static_cast<size_t>(std::countr_zero(lw));
+                    lw &= lw - 1;
+                    if (idx < limit && f(idx)) return true;
+                }
+            }
+        }
+        return false;
+    }
+
+private:
+    static AllocNW::AllocOptions words_opt(int node) noexcept {
+        AllocNW::AllocOptions opt;
+        opt.node = node;
+        return opt;
+    }
+    static std::atomic<uint64_t>* alloc_words(size_t n, int node) {
+        auto* w = reinterpret_cast<std::atomic<uint64_t>*>(AllocNW::Alloc(sizeof(std::atomic<uint64_t>) * n, words_opt(node)));
+        if (!w) throw std::bad_alloc(); // zero-filled
+        return w;
+    }
+    static void free_words(std::atomic<uint64_t>* w, size_t n, int node) noexcept {
+        if (!w) return;
+        AllocNW::Free(static_cast<void*>(w), sizeof(std::atomic<uint64_t>) * n, words_opt(node));
+    }
+
+    std::atomic<uint64_t>* leaf_{nullptr};
+    std::atomic<uint64_t>* sum_{nullptr};
+    size_t n_leaf_{0};
+    size_t n_sum_{0};
+    int node_{0};
+};
+
+// Striped occupancy counter. Threads add to their own cache-line stripe and fold it into
+// global_ once it drifts by fold_; approx() reads global_ (off by at most STRIPES * fold_),
+// exact() sums every stripe and is exact whenever no add is in flight.
+class StripedCounter {
+public:
+    static inline constexpr size_t STRIPES = THREAD_STRIPES;
+
+    // fold sized so the approximation stays within capacity/16; small mailboxes skip striping
+    explicit StripedCounter(size_t capacity = 0) noexcept { set_capacity(capacity); }
+
+    void set_capacity(size_t capacity) noexcept {
+        fold_ = static_cast<int64_t>(std::clamp<size_t>(capacity / (STRIPES * 16), 1, 64));
+    }
+
+    // returns the new global value when this call folded (or went direct), else -1
+    inline int64_t add(int64_t d) noexcept {
+        if (fold_ == 1) return global_.fetch_add(d, std::memory_order_acq_rel) + d;
+        auto &s = stripes_[thread_stripe()].v;
+        int64_t v = s.fetch_add(d, std::memory_order_relaxed) + d;
+        if (v < fold_ && v > -fold_) return -1;
+        int64_t take = s.exchange(0, std::memory_order_acq_rel);
+        return global_.fetch_add(take, std::memory_order_acq_rel) + take;
+    }
+
+    size_t approx() const noexcept {
+        int64_t g = global_.load(std::memory_order_acquire);
+        return g > 0 ? static_cast<size_t>(g) : 0;
+    }
+
+    size_t exact() const noexcept {
+        int64_t g = global_.load(std::memory_order_acquire);
+        for (auto &s : stripes_) g += s.v.load(std::memory_order_acquire);
+        return g > 0 ? static_cast<size_t>(g) : 0;
+    }
+
+    // worst-case distance between approx() and exact()
+    size_t slack() const noexcept { return fold_ == 1 ? 0 : STRIPES * static_cast<size_t>(fold_ - 1); }
+
+    void reset() noexcept {
+        global_.store(0, std::memory_order_relaxed);
+        for (auto &s : stripes_) s.v.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    struct alignas(64) Stripe { std::atomic<int64_t> v{0}; };
+
+    alignas(64) std::atomic<int64_t> global_{0};
+    int64_t fold_{1};
+    Stripe stripes_[STRIPES];
+};
+
+// Slot discipline:
+//   PROBE : publish takes any idle slot from a rotating cursor; claim_* filter by rel mask.
+//   FIFO  : bounded ring. Bits 32..47 of each cell (clk16 in MODE_VALUE32, the top 16 bits of
+//           clk48 in MODE_CLK48) hold the slot's lap, so publish/claim are O(1) CASes on
+//           prod_cursor_/cons_cursor_ and claims come out in publish order. rel is carried but
+//           not used for filtering; the lap bits of published items are overwritten.
+enum class MailboxOrder : int { PROBE = 0, FIFO = 1 };
+
+// Slot placement in memory (indices seen by callers are the same either way):
+//   LINEAR : slot i is cell i; eight consecutive slots share a cache line.
+//   SPREAD : slot i of the first capacity & ~7 slots lives at (i % 8) * lines + i / 8, so the
+//            consecutive slots that concurrent publishers take from the cursor sit on different
+//            lines. Needs capacity >= 64; linear below that. Un-indexed claim scans touch a line
+//            per slot, so pair it with published_index for scan-heavy consumers.
+enum class MailboxLayout : int { LINEAR = 0, SPREAD = 1 };
+
+struct MailboxOptions {
+    int node = 0;
+    HWCallback hw_cb = nullptr;
+    void* cb_user = nullptr;
+    bool published_index = false; // PROBE only: maintain a PublishedBitmap for claim_*
+    MailboxOrder order = MailboxOrder::PROBE;
+    AllocNW::AllocOptions alloc{};  // slot array pages/policy/populate; alloc.node is taken from node
+    MailboxLayout layout = MailboxLayout::LINEAR;
+};
+
+// WAIT: wait/backoff policy for every blocking API (see WaitStrategy.hpp)
+// STATS: NoStats or ContentionStats (see HotPathStats.hpp)
+template<PackedMode MODE, class WAIT = ParkWait, class STATS = NoStats>
+class MPMCArrayPacked {
+public:
+    // published_index: maintain a PublishedBitmap so claim_* visits only published slots
+    MPMCArrayPacked(size_t capacity, int node = 0, HWCallback hw_cb = nullptr, void* cb_user = nullptr,
+                    bool published_index = false)
+      : MPMCArrayPacked(capacity, MailboxOptions{node, hw_cb, cb_user, published_index, MailboxOrder::PROBE, {}}) {}
+
+    MPMCArrayPacked(size_t capacity, const MailboxOptions &opt)
+      : capacity_(capacity), occ_(capacity), cb_(opt.hw_cb), cb_user_(opt.cb_user), node_(opt.node), order_(opt.order)
+    {
+        if (capacity_ == 0) throw std::invalid_argument("capacity==0");
+        size_t bytes = sizeof(std::atomic<packed64_t>) * capacity_;
+        alloc_ = opt.alloc;
+        alloc_.node = node_;
+        raw_ = reinterpret_cast<std::atomic<packed64_t>*>(AllocNW::Alloc(bytes, alloc_, 64));
+        if (!raw_) throw std::bad_alloc(); // zero-filled == idle, lap 0
+        if (opt.layout == MailboxLayout::SPREAD && capacity_ >= 64) {
+            spread_cells_ = capacity_ & ~size_t(7);
+            lines_ = spread_cells_ / 8;
+        }
+        prod_cursor_.store(0, std::memory_order_relaxed);
+        cons_cursor_.store(0, std::memory_order_relaxed);
+        if (opt.published_index && order_ == MailboxOrder::PROBE) pub_.init(capacity_, node_);
+        stats_.init(capacity_);
+    }
+
+    ~MPMCArrayPacked() {
+        if (raw_) {
+            size_t bytes = sizeof(std::atomic<packed64_t>) * capacity_;
+            AllocNW::Free(static_cast<void*>(raw_), bytes, alloc_, 64);
+            raw_ = nullptr;
+        }
+    }
+
+    MPMCArrayPacked(const MPMCArrayPacked&) = delete;
+    MPMCArrayPacked& operator=(const MPMCArrayPacked&) = delete;
+
+    size_t capacity() const noexcept { return capacity_; }
+    // occupancy: cheap, within StripedCounter::slack() of the true count
+    size_t occupancy() const noexcept { return occ_.approx(); }
+    // occupancy_exact: sums every stripe; exact when no publish/recycle is in flight
+    size_t occupancy_exact() const noexcept { return occ_.exact(); }
+    // worst-case distance between occupancy() and occupancy_exact()
+    size_t occupancy_slack() const noexcept { return occ_.slack(); }
+    MailboxOrder order() const noexcept { return order_; }
+    MailboxLayout layout() const noexcept { return spread_cells_ ? MailboxLayout::SPREAD : MailboxLayout::LINEAR; }
+
+    // contention counters (all zero unless STATS = ContentionStats)
+    StatsSnapshot stats() const { return stats_.snapshot(); }
+    void reset_stats() noexcept { stats_.reset(); }
+
+    // publish: place item with ST_PUBLISHED into any free slot. Returns index or SIZE_MAX.
+    size_t publish(packed64_t item, int max_probes = -1) noexcept {
+        item = as_published(item);
+        stats_.add(STAT_PUBLISH_CALLS);
+        if (order_ == MailboxOrder::FIFO) return publish_fifo(item);
+        size_t idx = take_idle(item, max_probes);
+        if (idx == SIZE_MAX) return SIZE_MAX;
+        if (pub_.enabled()) pub_.set(idx);
+        ring_doorbells(PackedCell::rel_from_strel(PackedCell::extract_strel(item)));
+        check_hw(occ_.add(1));
+        return idx;
+    }
+
+    // reserve: take a free slot as ST_PENDING (rel and value/clock from item), invisible to
+    // claim_* but counted in occupancy. Fill the slot's side data (PayloadArray) and then call
+    // publish_reserved(idx). PROBE slots can be given back with recycle; a FIFO reservation
+    // must be published, the consumer at the ring head waits for it.
+    size_t reserve(packed64_t item, int max_probes = -1) noexcept {
+        item = PackedCell::set_st(item, ST_PENDING);
+        stats_.add(STAT_PUBLISH_CALLS);
+        if (order_ == MailboxOrder::FIFO) return publish_fifo(item);
+        size_t idx = take_idle(item, max_probes);
+        if (idx != SIZE_MAX) check_hw(occ_.add(1));
+        return idx;
+    }
+
+    // publish_reserved: flip a reserved slot to ST_PUBLISHED (release: the payload written
+    // since reserve is visible to whoever claims it)
+    void publish_reserved(size_t idx) noexcept {
+        if (idx >= capacity_) return;
+        packed64_t cur = cell(idx).load(std::memory_order_relaxed); // ours since reserve
+        if (state_of(cur) != ST_PENDING) return;
+        cell(idx).store(PackedCell::set_st(cur, ST_PUBLISHED), std::memory_order_release);
+        if (order_ == MailboxOrder::FIFO) {
+            if constexpr (WAIT::parks) {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                bells_[REL_BITS].notify_fenced();
+            }
+            return;
+        }
+        if (pub_.enabled()) pub_.set(idx);
+        ring_doorbells(PackedCell::rel_from_strel(PackedCell::extract_strel(cur)));
+    }
+
+    // publish_payload: reserve, fill the payload in place with fill(T&), publish.
+    // Returns the slot index or SIZE_MAX (fill not called; also when payloads holds fewer than
+    // capacity() entries). If fill throws, a PROBE slot is recycled; on a FIFO mailbox fill
+    // must not throw.
+    template<class T, class Fill>
+    size_t publish_payload(PayloadArray<T> &payloads, packed64_t item, Fill &&fill, int max_probes = -1) {
+        if (payloads.size() < capacity_) return SIZE_MAX;
+        size_t idx = reserve(item, max_probes);
+        if (idx == SIZE_MAX) return SIZE_MAX;
+        try {
+            fill(payloads[idx]);
+        } catch (...) {
+            if (order_ == MailboxOrder::PROBE) recycle(idx);
+            throw;
+        }
+        publish_reserved(idx);
+        return idx;
+    }
+
+    // publish_batch: publish items in order with one cursor reservation, one occupancy update,
+    // one high-water check and one doorbell round. Returns how many leading items were
+    // published (< items.size() when the mailbox filled up); out_idx, if given, must hold
+    // items.size() entries and receives their slot indices.
+    size_t publish_batch(std::span<const packed64_t> items, size_t *out_idx = nullptr) noexcept {
+        if (items.empty()) return 0;
+        if (order_ == MailboxOrder::FIFO) return publish_batch_fifo(items, out_idx);
+
+        const size_t n = items.size();
+        size_t idx = prod_cursor_.fetch_add(n, std::memory_order_relaxed) % capacity_;
+        size_t done = 0;
+        size_t probes = 0;
+        tag8_t rels = 0;
+        packed64_t item = as_published(items[0]);
+        for (; probes < capacity_ && done < n; ++probes, idx = (idx + 1) % capacity_) {
+            packed64_t cur = cell(idx).load(std::memory_order_acquire);
+            if (state_of(cur) != ST_IDLE) continue;
+            if (!cell(idx).compare_exchange_strong(cur, item, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                stats_.cas_fail(idx);
+                continue;
+            }
+            if (pub_.enabled()) pub_.set(idx);
+            rels |= PackedCell::rel_from_strel(PackedCell::extract_strel(item));
+            if (out_idx) out_idx[done] = idx;
+            if (++done < n) item = as_published(items[done]);
+        }
+        stats_.add(STAT_PUBLISH_CALLS);
+        stats_.add(STAT_PUBLISH_PROBES, probes);
+        if (done) publish_batch_done(done, rels);
+        return done;
+    }
+
+    // blocking publish with timeout (ms); between full-capacity rounds waits per WAIT
+    // (ParkWait sleeps until a recycle frees a slot)
+    size_t publish_blocking(packed64_t item, int timeout_ms = -1) noexcept {
+        size_t idx = SIZE_MAX;
+        WaitOps::retry<WAIT>([&]() noexcept {
+            idx = publish(item, static_cast<int>(capacity_));
+            if (idx == SIZE_MAX) stats_.add(STAT_BLOCK_ROUNDS);
+            return idx != SIZE_MAX;
+        }, timeout_ms, &space_);
+        return idx;
+    }
+
+    // consumer claim: try to claim any published slot whose rel matches rel_mask
+    bool claim_one(tag8_t rel_mask, size_t &out_idx, packed64_t &out_observed, int max_scans = -1) noexcept {
+        stats_.add(STAT_CLAIM_CALLS);
+        if (order_ == MailboxOrder::FIFO) return claim_fifo(out_idx, out_observed);
+        if (pub_.enabled()) {
+            int scans = 0;
+            uint64_t visited = 0;
+            bool got = false;
+            pub_.for_each_from(hash_start(rel_mask), capacity_, [&](size_t idx) {
+                if constexpr (STATS::enabled) ++visited;
+                if (try_claim_indexed(idx, rel_mask, out_observed)) { out_idx = idx; got = true; return true; }
+                return max_scans >= 0 && ++scans >= max_scans;
+            });
+            stats_.add(STAT_CLAIM_SCANS, visited);
+            return got;
+        }
+        size_t start = hash_start(rel_mask);
+        size_t idx = start;
+        int scans = 0;
+        while (true) {
+            packed64_t cur = cell(idx).load(std::memory_order_acquire);
+            strel_t csr = PackedCell::extract_strel(cur);
+            tag8_t st = PackedCell::st_from_strel(csr);
+            if (st == ST_PUBLISHED) {
+                tag8_t rel = PackedCell::rel_from_strel(csr);
+                if (rel_matches(rel, rel_mask)) {
+                    packed64_t desired = PackedCell::set_strel(cur, make_strel(ST_CLAIMED, rel));
+                    packed64_t exp = cur;
+                    if (cell(idx).compare_exchange_strong(exp, desired, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                        stats_.add(STAT_CLAIM_SCANS, static_cast<uint64_t>(scans) + 1);
+                        out_idx = idx;
+                        out_observed = cur;
+                        return true;
+                    }
+                    stats_.cas_fail(idx);
+                }
+            }
+            ++scans;
+            if (max_scans >= 0 && scans >= max_scans) { stats_.add(STAT_CLAIM_SCANS, static_cast<uint64_t>(scans)); return false; }
+            if (scans >= static_cast<int>(capacity_)) { stats_.add(STAT_CLAIM_SCANS, static_cast<uint64_t>(scans)); return false; }
+            idx = (idx + 1) % capacity_;
+        }
+    }
+
+    // blocking claim. ParkWait sleeps on the doorbells of rel_mask's bits between attempts:
+    // register + read epochs, re-try the claim, then sleep, so a publish that lands between the
+    // failed claim and the sleep is never missed. Polling policies retry with WAIT::pause.
+    bool claim_one_wait(tag8_t rel_mask, size_t &out_idx, packed64_t &out_observed, int timeout_ms = -1) noexcept {
+        if (claim_one(rel_mask, out_idx, out_observed)) return true;
+        if (timeout_ms == 0 || rel_mask == 0) return false;
+        if constexpr (!WAIT::parks) {
+            return WaitOps::retry<WAIT>([&]() noexcept { return claim_one(rel_mask, out_idx, out_observed); }, timeout_ms);
+        } else {
+            const bool has_deadline = timeout_ms > 0;
+            const FutexWait::Deadline d = FutexWait::deadline_after(timeout_ms);
+
+            std::atomic<uint32_t>* words[DOORBELLS];
+            uint32_t expect[DOORBELLS];
+            EventCount* bells[DOORBELLS];
+            size_t nb = 0;
+            // FIFO, or multi-bit mask without futex_waitv: shared doorbell rung by every publish
+            const bool shared = order_ == MailboxOrder::FIFO ||
+                (std::popcount(static_cast<unsigned>(rel_mask)) > 1 && !FutexWait::waitv_supported());
+            if (shared) bells[nb++] = &bells_[REL_BITS];
+            else for (unsigned m = rel_mask; m; m &= m - 1) bells[nb++] = &bells_[std::countr_zero(m)];
+            for (size_t j = 0; j < nb; ++j) { expect[j] = bells[j]->prepare(); words[j] = &bells[j]->epoch; }
+
+            bool got = false;
+            while (true) {
+                if (claim_one(rel_mask, out_idx, out_observed)) { got = true; break; }
+                const int rc = FutexWait::wait_words_any(words, expect, nb, has_deadline, d);
+                if (rc < 0) {
+                    // futex_waitv went away under us: re-arm on the shared doorbell and retry
+                    for (size_t j = 0; j < nb; ++j) bells[j]->cancel();
+                    nb = 1;
+                    bells[0] = &bells_[REL_BITS];
+                    expect[0] = bells[0]->prepare();
+                    words[0] = &bells[0]->epoch;
+                    continue;
+                }
+                // anything but a timeout (wake, EINTR, EAGAIN) still honours the deadline
+                if (rc == 0 || (has_deadline && std::chrono::steady_clock::now() >= d)) {
+                    got = claim_one(rel_mask, out_idx, out_observed);
+                    break;
+                }
+                for (size_t j = 0; j < nb; ++j) expect[j] = words[j]->load(std::memory_order_acquire);
+            }
+            for (size_t j = 0; j < nb; ++j) bells[j]->cancel();
+            return got;
+        }
+    }
+
+    // claim batch
+    size_t claim_batch(tag8_t rel_mask, std::vector<std::pair<size_t, packed64_t>> &out, size_t max_count) noexcept {
+        out.clear();
+        if (max_count == 0) return 0;
+        stats_.add(STAT_CLAIM_CALLS);
+        if (order_ == MailboxOrder::FIFO) {
+            size_t idx;
+            packed64_t observed;
+            while (out.size() < max_count && claim_fifo(idx, observed)) out.emplace_back(idx, observed);
+            return out.size();
+        }
+        if (pub_.enabled()) {
+            uint64_t visited = 0;
+            pub_.for_each_from(hash_start(rel_mask), capacity_, [&](size_t idx) {
+                packed64_t observed;
+                if constexpr (STATS::enabled) ++visited;
+                if (try_claim_indexed(idx, rel_mask, observed)) out.emplace_back(idx, observed);
+                return out.size() >= max_count;
+            });
+            stats_.add(STAT_CLAIM_SCANS, visited);
+            return out.size();
+        }
+        size_t start = hash_start(rel_mask);
+        size_t idx = start;
+        size_t scans = 0;
+        while (out.size() < max_count && scans < capacity_) {
+            packed64_t cur = cell(idx).load(std::memory_order_acquire);
+            strel_t csr = PackedCell::extract_strel(cur);
+            if (PackedCell::st_from_strel(csr) == ST_PUBLISHED) {
+                tag8_t rel = PackedCell::rel_from_strel(csr);
+                if (rel_matches(rel, rel_mask)) {
+                    packed64_t desired = PackedCell::set_strel(cur, make_strel(ST_CLAIMED, rel));
+                    packed64_t expected = cur;
+                    if (cell(idx).compare_exchange_strong(expected, desired, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                        out.emplace_back(idx, cur);
+                    } else {
+                        stats_.cas_fail(idx);
+                    }
+                }
+            }
+            ++scans;
+            idx = (idx + 1) % capacity_;
+        }
+        stats_.add(STAT_CLAIM_SCANS, scans);
+        return out.size();
+    }
+
+    // commit: consumer writes final packed (will set COMPLETE if not set)
+    void commit_index(size_t idx, packed64_t committed) noexcept {
+        if (idx >= capacity_) return;
+        strel_t csr = PackedCell::extract_strel(committed);
+        tag8_t st = PackedCell::st_from_strel(csr);
+        tag8_t rel = PackedCell::rel_from_strel(csr);
+        if (order_ == MailboxOrder::FIFO) // keep the slot's lap
+            committed = with_lap(committed, lap_of(cell(idx).load(std::memory_order_acquire)));
+        if (st != ST_COMPLETE) {
+            if constexpr (MODE == PackedMode::MODE_VALUE32)
+                committed = PackedCell::compose_value32(PackedCell::extract_value32(committed), PackedCell::extract_clk16(committed), ST_COMPLETE, rel);
+            else
+                committed = PackedCell::compose_clk48(PackedCell::extract_clk48(committed), ST_COMPLETE, rel);
+        }
+        cell(idx).store(committed, std::memory_order_release);
+        if constexpr (WAIT::parks) FutexWait::notify(&cell(idx));
+    }
+
+    // recycle by CPU: reset to IDLE and decrement occupancy
+    packed64_t recycle(size_t idx) noexcept {
+        if (idx >= capacity_) return packed64_t(0);
+        packed64_t prev = cell(idx).load(std::memory_order_acquire);
+        // FIFO: idle for the next lap so the producer one lap ahead can take it
+        packed64_t idle = order_ == MailboxOrder::FIFO ? with_lap(make_idle(), static_cast<uint16_t>(lap_of(prev) + 1)) : make_idle();
+        cell(idx).store(idle, std::memory_order_release);
+        if (pub_.enabled() && state_of(prev) == ST_PUBLISHED) unmark_published(idx);
+        occ_.add(-1);
+        if constexpr (WAIT::parks) {
+            FutexWait::notify(&cell(idx)); // includes the fence space_ pairs with
+            space_.notify_fenced();
+        }
+        return prev;
+    }
+
+    // wait for change on slot (futex-backed; timeout_ms < 0 waits forever, 0 checks once)
+    bool wait_slot_change(size_t idx, packed64_t expected, int timeout_ms = -1) const noexcept {
+        if (idx >= capacity_) return false;
+        return WaitOps::until<WAIT>(&cell(idx), [expected](packed64_t v) { return v != expected; }, timeout_ms);
+    }
+
+    // wait until the slot's state equals st (e.g. ST_COMPLETE)
+    bool wait_slot_state(size_t idx, tag8_t st, int timeout_ms = -1) const noexcept {
+        if (idx >= capacity_) return false;
+        return WaitOps::until<WAIT>(&cell(idx), [st](packed64_t v) { return state_of(v) == st; }, timeout_ms);
+    }
+
+    // wait until any of idxs reaches state st; returns that slot index, or SIZE_MAX on timeout
+    size_t wait_any_state(const std::vector<size_t> &idxs, tag8_t st, int timeout_ms = -1) const noexcept {
+        for (size_t i : idxs) if (i >= capacity_) return SIZE_MAX;
+        std::vector<size_t> phys;
+        if (spread_cells_) {
+            phys.reserve(idxs.size());
+            for (size_t i : idxs) phys.push_back(to_phys(i));
+        }
+        const size_t* p = spread_cells_ ? phys.data() : idxs.data();
+        size_t k = WaitOps::any<WAIT>(raw_, p, idxs.size(), [st](packed64_t v) { return state_of(v) == st; }, timeout_ms);
+        return k == SIZE_MAX ? SIZE_MAX : idxs[k];
+    }
+
+    // debug scan
+    std::vector<size_t> find_state(tag8_t st_filter) const noexcept {
+        std::vector<size_t> v;
+        v.reserve(64);
+        PackedScan::st_indices(raw_, 0, capacity_, st_filter, v);
+        if (spread_cells_) {
+            for (size_t &i : v) i = to_logical(i);
+            std::sort(v.begin(), v.end());
+        }
+        return v;
+    }
+
+private:
+    // slot index -> cell (see MailboxLayout); every cell access goes through here
+    inline size_t to_phys(size_t i) const noexcept {
+        return i < spread_cells_ ? (i & 7) * lines_ + (i >> 3) : i;
+    }
+    inline size_t to_logical(size_t p) const noexcept {
+        return p < spread_cells_ ? (p % lines_) * 8 + p / lines_ : p;
+    }
+    inline std::atomic<packed64_t>& cell(size_t i) const noexcept { return raw_[to_phys(i)]; }
+
+    inline packed64_t make_idle() const noexcept {
+        if constexpr (MODE == PackedMode::MODE_VALUE32)
+            return PackedCell::compose_value32(val32_t(0), clk16_t(0), ST_IDLE, tag8_t(0));
+        else
+            return PackedCell::compose_clk48(clk48_t(0), ST_IDLE, tag8_t(0));
+    }
+
+    // FIFO lap tag lives in bits 32..47 in both layouts
+    static inline constexpr unsigned LAP_SHIFT = 32;
+    static inline uint16_t lap_of(packed64_t p) noexcept { return static_cast<uint16_t>(p >> LAP_SHIFT); }
+    static inline packed64_t with_lap(packed64_t p, uint16_t lap) noexcept {
+        constexpr packed64_t m = low_mask(16) << LAP_SHIFT;
+        return (p & ~m) | (packed64_t(lap) << LAP_SHIFT);
+    }
+    inline uint16_t lap_for(size_t pos) const noexcept { return static_cast<uint16_t>(pos / capacity_); }
+
+    // PROBE: CAS word into the first idle slot from the producer cursor
+    size_t take_idle(packed64_t word, int max_probes) noexcept {
+        size_t start = prod_cursor_.fetch_add(1, std::memory_order_relaxed);
+        size_t idx = start % capacity_;
+        int probes = 0;
+        while (true) {
+            packed64_t cur = cell(idx).load(std::memory_order_acquire);
+            if (state_of(cur) == ST_IDLE) {
+                packed64_t expected = cur;
+                if (cell(idx).compare_exchange_strong(expected, word, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                    stats_.add(STAT_PUBLISH_PROBES, static_cast<uint64_t>(probes) + 1);
+                    return idx;
+                }
+                stats_.cas_fail(idx);
+            }
+            ++probes;
+            if (max_probes >= 0 && probes >= max_probes) { stats_.add(STAT_PUBLISH_PROBES, static_cast<uint64_t>(probes)); return SIZE_MAX; }
+            if (probes >= static_cast<int>(capacity_)) { stats_.add(STAT_PUBLISH_PROBES, static_cast<uint64_t>(probes)); return SIZE_MAX; }
+            idx = (idx + 1) % capacity_;
+        }
+    }
+
+    // FIFO enqueue: slot pos % capacity is free for lap(pos) when it is (ST_IDLE, lap(pos)).
+    // item is ST_PUBLISHED, or ST_PENDING for reserve (no doorbell until publish_reserved).
+    size_t publish_fifo(packed64_t item) noexcept {
+        size_t pos = prod_cursor_.load(std::memory_order_relaxed);
+        while (true) {
+            size_t idx = pos % capacity_;
+            uint16_t lap = lap_for(pos);
+            packed64_t cur = cell(idx).load(std::memory_order_acquire);
+            int16_t diff = static_cast<int16_t>(lap_of(cur) - lap);
+            if (diff == 0 && state_of(cur) == ST_IDLE) {
+                if (prod_cursor_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed, std::memory_order_relaxed)) {
+                    cell(idx).store(with_lap(item, lap), std::memory_order_release);
+                    if constexpr (WAIT::parks) {
+                        if (state_of(item) == ST_PUBLISHED) {
+                            std::atomic_thread_fence(std::memory_order_seq_cst);
+                            bells_[REL_BITS].notify_fenced();
+                        }
+                    }
+                    check_hw(occ_.add(1));
+                    return idx;
+                }
+                stats_.cas_fail(idx);
+            } else if (diff < 0) {
+                return SIZE_MAX; // previous lap still occupies the slot: ring full
+            } else {
+                pos = prod_cursor_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // FIFO bulk enqueue: count the free run at the tail, take it with one cursor CAS
+    size_t publish_batch_fifo(std::span<const packed64_t> items, size_t *out_idx) noexcept {
+        const size_t want = std::min(items.size(), capacity_);
+        size_t pos = prod_cursor_.load(std::memory_order_relaxed);
+        size_t run;
+        while (true) {
+            run = 0;
+            bool stale = false;
+            while (run < want) {
+                packed64_t cur = cell((pos + run) % capacity_).load(std::memory_order_acquire);
+                int16_t diff = static_cast<int16_t>(lap_of(cur) - lap_for(pos + run));
+                if (diff == 0 && state_of(cur) == ST_IDLE) { ++run; continue; }
+                // slot taken for this lap (in flight or already past it): cursor moved on
+                stale = diff > 0 || (diff == 0 && state_of(cur) != ST_IDLE);
+                break;
+            }
+            if (run == 0 && !stale) return 0; // full
+            if (run == 0) { pos = prod_cursor_.load(std::memory_order_relaxed); continue; }
+            if (prod_cursor_.compare_exchange_weak(pos, pos + run, std::memory_order_relaxed, std::memory_order_relaxed)) break;
+            stats_.cas_fail(pos % capacity_);
+        }
+        for (size_t i = 0; i < run; ++i) {
+            size_t idx = (pos + i) % capacity_;
+            cell(idx).store(with_lap(as_published(items[i]), lap_for(pos + i)), std::memory_order_release);
+            if (out_idx) out_idx[i] = idx;
+        }
+        publish_batch_done(run, 0);
+        return run;
+    }
+
+    // one occupancy update, high-water check and doorbell round for a published batch
+    inline void publish_batch_done(size_t count, tag8_t rels) noexcept {
+        if constexpr (WAIT::parks) {
+            if (order_ == MailboxOrder::FIFO) {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                bells_[REL_BITS].notify_fenced();
+            } else {
+                ring_doorbells(rels);
+            }
+        } else {
+            (void)rels;
+        }
+        check_hw(occ_.add(static_cast<int64_t>(count)));
+    }
+
+    // force ST_PUBLISHED into the state byte, keeping rel and payload
+    static inline packed64_t as_published(packed64_t item) noexcept {
+        strel_t sr = PackedCell::extract_strel(item);
+        if (PackedCell::st_from_strel(sr) == ST_PUBLISHED) return item;
+        tag8_t rel = PackedCell::rel_from_strel(sr);
+        if constexpr (MODE == PackedMode::MODE_VALUE32)
+            return PackedCell::compose_value32(PackedCell::extract_value32(item), PackedCell::extract_clk16(item), ST_PUBLISHED, rel);
+        else
+            return PackedCell::compose_clk48(PackedCell::extract_clk48(item), ST_PUBLISHED, rel);
+    }
+
+    // FIFO dequeue: head slot must be (ST_PUBLISHED, lap(pos))
+    bool claim_fifo(size_t &out_idx, packed64_t &out_observed) noexcept {
+        size_t pos = cons_cursor_.load(std::memory_order_relaxed);
+        while (true) {
+            size_t idx = pos % capacity_;
+            packed64_t cur = cell(idx).load(std::memory_order_acquire);
+            int16_t diff = static_cast<int16_t>(lap_of(cur) - lap_for(pos));
+            tag8_t st = state_of(cur);
+            if (diff == 0 && st == ST_PUBLISHED) {
+                if (cons_cursor_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed, std::memory_order_relaxed)) {
+                    tag8_t rel = PackedCell::rel_from_strel(PackedCell::extract_strel(cur));
+                    cell(idx).store(PackedCell::set_strel(cur, make_strel(ST_CLAIMED, rel)), std::memory_order_release);
+                    out_idx = idx;
+                    out_observed = cur;
+                    return true;
+                }
+                stats_.cas_fail(idx);
+            } else if (diff < 0 || (diff == 0 && (st == ST_IDLE || st == ST_PENDING))) {
+                return false; // nothing published at the head yet (or still being filled)
+            } else {
+                pos = cons_cursor_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // one eventcount per relation bit, plus a shared one for multi-bit waiters without futex_waitv
+    static inline constexpr unsigned REL_BITS = 8;
+    static inline constexpr unsigned DOORBELLS = REL_BITS + 1;
+
+    // ring only the doorbells of the published rel bits (one fence + a few loads when nobody sleeps)
+    inline void ring_doorbells(tag8_t rel) noexcept {
+        if constexpr (WAIT::parks) {
+            if (rel == 0) return;
+            std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with EventCount::prepare
+            for (unsigned m = rel; m; m &= m - 1) bells_[std::countr_zero(m)].notify_fenced();
+            bells_[REL_BITS].notify_fenced();
+        } else {
+            (void)rel;
+        }
+    }
+
+    static inline tag8_t state_of(packed64_t p) noexcept {
+        return PackedCell::st_from_strel(PackedCell::extract_strel(p));
+    }
+
+    // clear a slot's published bit, re-arming it if the slot was re-published meanwhile
+    inline void unmark_published(size_t idx) noexcept {
+        pub_.clear(idx);
+        if (state_of(cell(idx).load()) == ST_PUBLISHED) pub_.set(idx);
+    }
+
+    // bitmap candidate: claim if published and rel matches; drop the bit once it is not published
+    inline bool try_claim_indexed(size_t idx, tag8_t rel_mask, packed64_t &out_observed) noexcept {
+        packed64_t cur = cell(idx).load(std::memory_order_acquire);
+        strel_t csr = PackedCell::extract_strel(cur);
+        if (PackedCell::st_from_strel(csr) != ST_PUBLISHED) { unmark_published(idx); return false; }
+        tag8_t rel = PackedCell::rel_from_strel(csr);
+        if (!rel_matches(rel, rel_mask)) return false;
+        packed64_t desired = PackedCell::set_strel(cur, make_strel(ST_CLAIMED, rel));
+        packed64_t exp = cur;
+        if (!cell(idx).compare_exchange_strong(exp, desired, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+            stats_.cas_fail(idx);
+            return false;
+        }
+        unmark_published(idx);
+        out_observed = cur;
+        return true;
+    }
+
+    inline size_t hash_start(tag8_t rel_mask) const noexcept {
+        uint64_t key = static_cast<uint64_t>(rel_mask);
+        uint64_t mixed = key * HASH_CONST;
+        // top bit_width(capacity-1) bits: log2(capacity) for powers of two, so idx < capacity
+        unsigned bw = std::bit_width(capacity_ - 1);
+        if (bw == 0) return 0;
+        size_t idx = static_cast<size_t>(mixed >> (64 - bw));
+        if ((capacity_ & (capacity_ - 1)) != 0) idx %= capacity_;
+        return idx;
+    }
+
+    // folded: global occupancy after an add that folded its stripe, -1 otherwise.
+    // Only near the 80% mark is the exact sum taken to confirm.
+    inline void check_hw(int64_t folded) noexcept {
+        if (!cb_ || folded < 0) return;
+        if ((static_cast<size_t>(folded) + occ_.slack()) * 10 < capacity_ * 8) return;
+        size_t occ = occ_.exact();
+        if (occ * 10 < capacity_ * 8) return;
+        stats_.add(STAT_HW_HITS);
+        cb_(occ, capacity_, cb_user_);
+    }
+
+    std::atomic<packed64_t>* raw_{nullptr};
+    size_t capacity_{0};
+    size_t spread_cells_{0}; // SPREAD: leading slots that are remapped (0 = LINEAR)
+    size_t lines_{0};
+    StripedCounter occ_;
+    // cursors on lines of their own, away from each other and the read-mostly fields below
+    alignas(64) std::atomic<size_t> prod_cursor_{0};
+    alignas(64) std::atomic<size_t> cons_cursor_{0};
+    alignas(64) HWCallback cb_{nullptr};
+    void* cb_user_{nullptr};
+    int node_{0};
+    AllocNW::AllocOptions alloc_{};
+    MailboxOrder order_{MailboxOrder::PROBE};
+    PublishedBitmap pub_;
+    EventCount bells_[DOORBELLS];
+    EventCount space_; // rung by recycle for parked publish_blocking callers
+    [[no_unique_address]] HotPathStats<STATS::enabled> stats_;
+};
+
+} // namespace AtomicCScompact
+#pragma once
+// ShardedMailbox.hpp
+// NUMA-sharded front-end over MPMCArrayPacked: one sub-mailbox per node (or per core group when
+// a node is listed several times). Producers publish to the shard of the CPU they run on and
+// spill to other shards when it is full; consumers claim locally, then steal from the other
+// shards in NUMA-distance order. Returned indices are global: shard * shard_capacity + slot.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <span>
+#include <stdexcept>
+
+#if defined(HAVE_LIBNUMA)
+    #include <numa.h>
+    #include <sched.h>
+#endif
+
+
+namespace AtomicCScompact {
+
+template<PackedMode MODE, class WAIT = ParkWait, class STATS = NoStats>
+class ShardedMailbox {
+public:
+    using Shard = MPMCArrayPacked<MODE, WAIT, STATS>;
+
+    // shard_nodes: node of each shard; empty = one shard per available NUMA node
+    ShardedMailbox(size_t capacity_per_shard, std::vector<int> shard_nodes = {}, HWCallback hw_cb = nullptr,
+                   void* cb_user = nullptr, bool published_index = false)
+      : ShardedMailbox(capacity_per_shard, std::move(shard_nodes),
+                       MailboxOptions{0, hw_cb, cb_user, published_index, MailboxOrder::PROBE, {}}) {}
+
+    // every shard gets opt (order, layout, alloc, published_index) with node replaced by its
+    // own; opt.hw_cb fires on the aggregate occupancy, not per shard
+    ShardedMailbox(size_t capacity_per_shard, std::vector<int> shard_nodes, const MailboxOptions &opt)
+      : shard_cap_(capacity_per_shard), cb_(opt.hw_cb), cb_user_(opt.cb_user)
+    {
+        if (shard_cap_ == 0) throw std::invalid_argument("capacity_per_shard==0");
+        if (shard_nodes.empty()) shard_nodes = available_nodes();
+        nodes_ = std::move(shard_nodes);
+        shards_.reserve(nodes_.size());
+        MailboxOptions so = opt;
+        so.hw_cb = nullptr;
+        so.cb_user = nullptr;
+        for (int node : nodes_) {
+            so.node = node;
+            shards_.emplace_back(new Shard(shard_cap_, so));
+        }
+        build_cpu_map();
+        build_steal_order();
+    }
+
+    ShardedMailbox(const ShardedMailbox&) = delete;
+    ShardedMailbox& operator=(const ShardedMailbox&) = delete;
+
+    size_t shards() const noexcept { return shards_.size(); }
+    size_t shard_capacity() const noexcept { return shard_cap_; }
+    size_t capacity() const noexcept { return shard_cap_ * shards_.size(); }
+    Shard& shard(size_t s) noexcept { return *shards_[s]; }
+    int shard_node(size_t s) const noexcept { return nodes_[s]; }
+
+    size_t occupancy() const noexcept {
+        size_t occ = 0;
+        for (auto &s : shards_) occ += s->occupancy();
+        return occ;
+    }
+
+    size_t occupancy_exact() const noexcept {
+        size_t occ = 0;
+        for (auto &s : shards_) occ += s->occupancy_exact();
+        return occ;
+    }
+
+    // counters summed over shards; heat is the concatenation of the shards' heatmaps
+    StatsSnapshot stats() const {
+        StatsSnapshot out;
+        for (auto &s : shards_) {
+            StatsSnapshot one = s->stats();
+            for (unsigned c = 0; c < STAT_COUNT; ++c) out.counters[c] += one.counters[c];
+            out.heat.insert(out.heat.end(), one.heat.begin(), one.heat.end());
+        }
+        return out;
+    }
+
+    // shard serving the calling thread's current CPU (CPU id re-sampled every 1024 calls)
+    size_t local_shard() const noexcept {
+        if (shards_.size() == 1) return 0;
+        int cpu = current_cpu();
+        return (cpu >= 0 && static_cast<size_t>(cpu) < cpu_shard_.size()) ? cpu_shard_[cpu] : 0;
+    }
+
+    // publish locally; spill to other shards (nearest first) when the local shard is full
+    size_t publish(packed64_t item, int max_probes = -1) noexcept {
+        size_t home = local_shard();
+        for (size_t s : steal_order_[home]) {
+            size_t idx = shards_[s]->publish(item, max_probes);
+            if (idx != SIZE_MAX) { note_published(1); return to_global(s, idx); }
+        }
+        return SIZE_MAX;
+    }
+
+    // batch publish with the same spill order; returns how many leading items were published
+    size_t publish_batch(std::span<const packed64_t> items, size_t *out_idx = nullptr) noexcept {
+        size_t done = 0;
+        size_t home = local_shard();
+        for (size_t s : steal_order_[home]) {
+            if (done == items.size()) break;
+            size_t *dst = out_idx ? out_idx + done : nullptr;
+            size_t k = shards_[s]->publish_batch(items.subspan(done), dst);
+            if (dst) for (size_t i = 0; i < k; ++i) dst[i] = to_global(s, dst[i]);
+            done += k;
+        }
+        note_published(done);
+        return done;
+    }
+
+    size_t publish_on(size_t shard, packed64_t item, int max_probes = -1) noexcept {
+        if (shard >= shards_.size()) return SIZE_MAX;
+        size_t idx = shards_[shard]->publish(item, max_probes);
+        if (idx == SIZE_MAX) return SIZE_MAX;
+        note_published(1);
+        return to_global(shard, idx);
+    }
+
+    // claim locally first, then steal from remote shards in distance order
+    bool claim_one(tag8_t rel_mask, size_t &out_idx, packed64_t &out_observed, int max_scans = -1) noexcept {
+        size_t home = local_shard();
+        for (size_t s : steal_order_[home]) {
+            size_t idx;
+            if (shards_[s]->claim_one(rel_mask, idx, out_observed, max_scans)) {
+                out_idx = to_global(s, idx);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t claim_batch(tag8_t rel_mask, std::vector<std::pair<size_t, packed64_t>> &out, size_t max_count) noexcept {
+        out.clear();
+        std::vector<std::pair<size_t, packed64_t>> part;
+        size_t home = local_shard();
+        for (size_t s : steal_order_[home]) {
+            if (out.size() >= max_count) break;
+            shards_[s]->claim_batch(rel_mask, part, max_count - out.size());
+            for (auto &e : part) out.emplace_back(to_global(s, e.first), e.second);
+        }
+        return out.size();
+    }
+
+    void commit_index(size_t gidx, packed64_t committed) noexcept {
+        if (gidx >= capacity()) return;
+        shards_[gidx / shard_cap_]->commit_index(gidx % shard_cap_, committed);
+    }
+
+    packed64_t recycle(size_t gidx) noexcept {
+        if (gidx >= capacity()) return packed64_t(0);
+        return shards_[gidx / shard_cap_]->recycle(gidx % shard_cap_);
+    }
+
+    bool wait_slot_change(size_t gidx, packed64_t expected, int timeout_ms = -1) const noexcept {
+        if (gidx >= capacity()) return false;
+        return shards_[gidx / shard_cap_]->wait_slot_change(gidx % shard_cap_, expected, timeout_ms);
+    }
+
+private:
+    inline size_t to_global(size_t shard, size_t idx) const noexcept { return shard * shard_cap_ + idx; }
+
+    // aggregate 80% mark, checked on every front-end publish (local or spilled) against the
+    // shards' own counters, so traffic through shard() is counted too. The approximate sum
+    // filters; the exact sum confirms.
+    inline void note_published(size_t n) noexcept {
+        if (!cb_ || n == 0) return;
+        size_t approx = 0;
+        for (auto &s : shards_) approx += s->occupancy() + s->occupancy_slack();
+        const size_t cap = capacity();
+        if (approx * 10 < cap * 8) return;
+        size_t occ = occupancy_exact();
+        if (occ * 10 >= cap * 8) cb_(occ, cap, cb_user_);
+    }
+
+    static std::vector<int> available_nodes() {
+        std::vector<int> nodes;
+#if defined(HAVE_LIBNUMA)
+        if (numa_available() >= 0) {
+            for (int n = 0; n <= numa_max_node(); ++n)
+                if (numa_bitmask_isbitset(numa_all_nodes_ptr, static_cast<unsigned>(n))) nodes.push_back(n);
+        }
+#endif
+        if (nodes.empty()) nodes.push_back(0);
+        return nodes;
+    }
+
+    static int current_cpu() noexcept {
+#if defined(HAVE_LIBNUMA)
+        thread_local int cpu = -1;
+        thread_local unsigned calls = 0;
+        if (cpu < 0 || (++calls & 1023u) == 0) cpu = sched_getcpu();
+        return cpu;
+#else
+        return 0;
+#endif
+    }
+
+    // CPUs of a node are dealt round-robin over that node's shards (core groups)
+    void build_cpu_map() {
+#if defined(HAVE_LIBNUMA)
+        if (numa_available() < 0) return;
+        int ncpu = numa_num_configured_cpus();
+        cpu_shard_.assign(static_cast<size_t>(std::max(ncpu, 0)), 0);
+        std::vector<size_t> rank(static_cast<size_t>(numa_max_node()) + 1, 0);
+        for (int c = 0; c < ncpu; ++c) {
+            int node = numa_node_of_cpu(c);
+            if (node < 0) continue;
+            std::vector<size_t> mine;
+            for (size_t s = 0; s < nodes_.size(); ++s) if (nodes_[s] == node) mine.push_back(s);
+            if (mine.empty()) continue;
+            cpu_shard_[c] = mine[rank[node]++ % mine.size()];
+        }
+#endif
+    }
+
+    // per home shard: itself first, then the others by NUMA distance (ties by index)
+    void build_steal_order() {
+        size_t n = shards_.size();
+        steal_order_.assign(n, {});
+        for (size_t h = 0; h < n; ++h) {
+            auto &order = steal_order_[h];
+            for (size_t k = 0; k < n; ++k) order.push_back((h + k) % n);
+            std::stable_sort(order.begin() + 1, order.end(), [&](size_t a, size_t b) {
+                return node_distance(nodes_[h], nodes_[a]) < node_distance(nodes_[h], nodes_[b]);
+            });
+        }
+    }
+
+    static int node_distance(int a, int b) noexcept {
+#if defined(HAVE_LIBNUMA)
+        if (numa_available() >= 0) return numa_distance(a, b);
+#endif
+        return a == b ? 10 : 20;
+    }
+
+    size_t shard_cap_{0};
+    std::vector<int> nodes_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::vector<size_t> cpu_shard_;
+    std::vector<std::vector<size_t>> steal_order_;
+    HWCallback cb_{nullptr};
+    void* cb_user_{nullptr};
+};
+
+} // namespace AtomicCScompact
+#pragma once
+// ShmMailbox.hpp
+// Cross-process mailbox: the cell array, producer cursor, occupancy and doorbells all live in
+// one shared segment (POSIX shm name or memfd), so separate processes publish/claim cells
+// directly. Same PROBE discipline and cell protocol as MPMCArrayPacked; waits use
+// process-shared futexes. Segment layout: ShmMailboxHeader (page-padded), then capacity cells.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+    #include <cerrno>
+    #include <cstring>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "AllocNW.hpp"
+
+namespace AtomicCScompact {
+
+#if defined(__linux__)
+
+struct ShmMailboxHeader {
+    static inline constexpr uint64_t MAGIC = 0x3142414D53434341ull; // "ACCSMAB1"
+    static inline constexpr uint32_t VERSION = 1;
+    uint64_t magic;
+    uint32_t version;
+    uint32_t mode;
+    uint64_t capacity;
+    uint64_t data_offset;
+    std::atomic<uint32_t> ready;               // set by the creator once the segment is initialised
+    alignas(64) std::atomic<size_t> prod_cursor;
+    // stripes are shared across processes and can collide: thread_stripe() numbers threads from
+    // 0 in each process. Collisions only add contention; every stripe update is atomic.
+    StripedCounter occ;
+    SharedEventCount bell;                     // rung by publish
+    SharedEventCount space;                    // rung by recycle
+};
+
+enum class ShmOpen : int { CREATE = 0, ATTACH = 1 };
+
+template<PackedMode MODE, class WAIT = ParkWait>
+class ShmMailbox {
+public:
+    // POSIX shm segment (name like "/acs_mailbox"). CREATE fails if it already exists, and
+    // unlinks the name again if setting it up fails; remove it with unlink(name) once no
+    // process needs it. ATTACH waits up to ATTACH_WAIT_MS for a creator still setting up.
+    ShmMailbox(const std::string &shm_name, ShmOpen how, size_t capacity = 0) {
+        int flags = how == ShmOpen::CREATE ? (O_RDWR | O_CREAT | O_EXCL) : O_RDWR;
+        int fd = ::shm_open(shm_name.c_str(), flags | O_CLOEXEC, 0600);
+        if (fd < 0) throw std::runtime_error("shm_open " + shm_name + ": " + std::strerror(errno));
+        if (how == ShmOpen::CREATE) created_name_ = shm_name;
+        open_fd(fd, how, capacity);
+        created_name_.clear();
+    }
+
+    // memfd / inherited fd. CREATE with fd < 0 makes a new memfd; pass fd() to peers
+    // (SCM_RIGHTS or fork) and ATTACH there. The fd is duplicated, the caller keeps theirs.
+    ShmMailbox(int fd, ShmOpen how, size_t capacity = 0) {
+        int own = fd < 0 ? ::memfd_create("acs_mailbox", MFD_CLOEXEC) : ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (own < 0) throw std::runtime_error(std::string("memfd/dup: ") + std::strerror(errno));
+        open_fd(own, how, capacity);
+    }
+
+    ~ShmMailbox() {
+        if (base_) ::munmap(base_, bytes_);
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    ShmMailbox(const ShmMailbox&) = delete;
+    ShmMailbox& operator=(const ShmMailbox&) = delete;
+
+    static void unlink(const std::string &shm_name) noexcept { ::shm_unlink(shm_name.c_str()); }
+
+    // how long ATTACH waits for the creator's ftruncate and header setup
+    static inline constexpr int ATTACH_WAIT_MS = 1000;
+
+    int fd() const noexcept { return fd_; }
+    size_t capacity() const noexcept { return capacity_; }
+    size_t occupancy() const noexcept { return hdr_->occ.approx(); }
+    size_t occupancy_exact() const noexcept { return hdr_->occ.exact(); }
+
+    // publish: place item with ST_PUBLISHED into any idle slot. Returns index or SIZE_MAX.
+    size_t publish(packed64_t item, int max_probes = -1) noexcept {
+        item = as_published(item);
+        size_t idx = hdr_->prod_cursor.fetch_add(1, std::memory_order_relaxed) % capacity_;
+        const size_t limit = max_probes >= 0 ? std::min(capacity_, static_cast<size_t>(max_probes)) : capacity_;
+        for (size_t probes = 0; probes < limit; ++probes, idx = (idx + 1) % capacity_) {
+            packed64_t cur = cells_[idx].load(std::memory_order_acquire);
+            if (state_of(cur) != ST_IDLE) continue;
+            if (!cells_[idx].compare_exchange_strong(cur, item, std::memory_order_acq_rel, std::memory_order_relaxed)) continue;
+            if constexpr (WAIT::parks) hdr_->bell.notify();
+            hdr_->occ.add(1);
+            return idx;
+        }
+        return SIZE_MAX;
+    }
+
+    size_t publish_blocking(packed64_t item, int timeout_ms = -1) noexcept {
+        size_t idx = SIZE_MAX;
+        WaitOps::retry<WAIT>([&]() noexcept {
+            idx = publish(item);
+            return idx != SIZE_MAX;
+        }, timeout_ms, &hdr_->space);
+        return idx;
+    }
+
+    // claim any published slot whose rel matches rel_mask (scan starts at a per-mask offset)
+    bool claim_one(tag8_t rel_mask, size_t &out_idx, packed64_t &out_observed) noexcept {
+        size_t idx = (static_cast<uint64_t>(rel_mask) * HASH_CONST >> 32) % capacity_;
+        for (size_t scans = 0; scans < capacity_; ++scans, idx = (idx + 1) % capacity_)
+            if (try_claim(idx, rel_mask, out_observed)) { out_idx = idx; return true; }
+        return false;
+    }
+
+    // blocking claim: parks on the segment's doorbell between attempts (any process' publish rings it)
+    bool claim_one_wait(tag8_t rel_mask, size_t &out_idx, packed64_t &out_observed, int timeout_ms = -1) noexcept {
+        return WaitOps::retry<WAIT>([&]() noexcept { return claim_one(rel_mask, out_idx, out_observed); },
+                                    timeout_ms, &hdr_->bell);
+    }
+
+    size_t claim_batch(tag8_t rel_mask, std::vector<std::pair<size_t, packed64_t>> &out, size_t max_count) noexcept {
+        out.clear();
+        size_t idx = (static_cast<uint64_t>(rel_mask) * HASH_CONST >> 32) % capacity_;
+        for (size_t scans = 0; scans < capacity_ && out.size() < max_count; ++scans, idx = (idx + 1) % capacity_) {
+            packed64_t observed;
+            if (try_claim(idx, rel_mask, observed)) out.emplace_back(idx, observed);
+        }
+        return out.size();
+    }
+
+    // commit: consumer writes the final packed value (forced to ST_COMPLETE)
+    void commit_index(size_t idx, packed64_t committed) noexcept {
+        if (idx >= capacity_) return;
+        strel_t sr = PackedCell::extract_strel(committed);
+        cells_[idx].store(PackedCell::set_strel(committed, make_strel(ST_COMPLETE, PackedCell::rel_from_strel(sr))),
+                          std::memory_order_release);
+    }
+
+    packed64_t recycle(size_t idx) noexcept {
+        if (idx >= capacity_) return packed64_t(0);
+        packed64_t prev = cells_[idx].exchange(make_idle(), std::memory_order_acq_rel);
+        hdr_->occ.add(-1);
+        if constexpr (WAIT::parks) hdr_->space.notify();
+        return prev;
+    }
+
+    packed64_t load(size_t idx) const noexcept {
+        return idx < capacity_ ? cells_[idx].load(std::memory_order_acquire) : packed64_t(0);
+    }
+
+private:
+    void open_fd(int fd, ShmOpen how, size_t capacity) {
+        fd_ = fd;
+        const size_t data_off = (sizeof(ShmMailboxHeader) + AllocNW::PageSize() - 1) / AllocNW::PageSize() * AllocNW::PageSize();
+        if (how == ShmOpen::CREATE) {
+            if (capacity == 0) fail("capacity==0");
+            bytes_ = data_off + capacity * sizeof(std::atomic<packed64_t>);
+            if (::ftruncate(fd_, static_cast<off_t>(bytes_)) != 0) fail(std::string("ftruncate: ") + std::strerror(errno));
+        } else {
+            // a creator between shm_open and ftruncate leaves the segment empty for a moment
+            for (unsigned round = 0;; ++round) {
+                struct stat sb;
+                if (::fstat(fd_, &sb) != 0) fail(std::string("fstat: ") + std::strerror(errno));
+                bytes_ = static_cast<size_t>(sb.st_size);
+                if (bytes_ >= data_off) break;
+                if (!attach_backoff(round)) fail("segment too small");
+            }
+        }
+        base_ = ::mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (base_ == MAP_FAILED) { base_ = nullptr; fail(std::string("mmap: ") + std::strerror(errno)); }
+        hdr_ = static_cast<ShmMailboxHeader*>(base_);
+        cells_ = reinterpret_cast<std::atomic<packed64_t>*>(static_cast<char*>(base_) + data_off);
+
+        if (how == ShmOpen::CREATE) {
+            // fresh segment is zero-filled; construct in place and publish ready last
+            capacity_ = capacity;
+            hdr_->magic = ShmMailboxHeader::MAGIC;
+            hdr_->version = ShmMailboxHeader::VERSION;
+            hdr_->mode = static_cast<uint32_t>(MODE);
+            hdr_->capacity = capacity;
+            hdr_->data_offset = data_off;
+            new (&hdr_->prod_cursor) std::atomic<size_t>(0);
+            new (&hdr_->occ) StripedCounter(capacity);
+            new (&hdr_->bell) SharedEventCount();
+            new (&hdr_->space) SharedEventCount();
+            for (size_t i = 0; i < capacity_; ++i) new (&cells_[i]) std::atomic<packed64_t>(make_idle());
+            new (&hdr_->ready) std::atomic<uint32_t>(0);
+            hdr_->ready.store(1, std::memory_order_release);
+            return;
+        }
+        for (unsigned round = 0; hdr_->ready.load(std::memory_order_acquire) != 1; ++round)
+            if (!attach_backoff(round)) fail("segment not initialised");
+        if (hdr_->magic != ShmMailboxHeader::MAGIC) fail("bad magic");
+        if (hdr_->version != ShmMailboxHeader::VERSION) fail("layout version mismatch");
+        if (hdr_->mode != static_cast<uint32_t>(MODE)) fail("PackedMode mismatch");
+        if (hdr_->data_offset != data_off || bytes_ != data_off + hdr_->capacity * sizeof(packed64_t)) fail("geometry mismatch");
+        capacity_ = hdr_->capacity;
+    }
+
+    // sleep between ATTACH polls; false once ATTACH_WAIT_MS has passed
+    static bool attach_backoff(unsigned round) noexcept {
+        constexpr unsigned STEP_MS = 1;
+        if (round * STEP_MS >= static_cast<unsigned>(ATTACH_WAIT_MS)) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(STEP_MS));
+        return true;
+    }
+
+    [[noreturn]] void fail(const std::string &what) {
+        if (base_) ::munmap(base_, bytes_);
+        ::close(fd_);
+        if (!created_name_.empty()) ::shm_unlink(created_name_.c_str());
+        created_name_.clear();
+        base_ = nullptr;
+        fd_ = -1;
+        throw std::runtime_error("ShmMailbox: " + what);
+    }
+
+    inline bool try_claim(size_t idx, tag8_t rel_mask, packed64_t &out_observed) noexcept {
+        packed64_t cur = cells_[idx].load(std::memory_order_acquire);
+        strel_t csr = PackedCell::extract_strel(cur);
+        if (PackedCell::st_from_strel(csr) != ST_PUBLISHED) return false;
+        tag8_t rel = PackedCell::rel_from_strel(csr);
+        if (!rel_matches(rel, rel_mask)) return false;
+        if (!cells_[idx].compare_exchange_strong(cur, PackedCell::set_strel(cur, make_strel(ST_CLAIMED, rel)),
+                                                 std::memory_order_acq_rel, std::memory_order_relaxed)) return false;
+        out_observed = cur;
+        return true;
+    }
+
+    static inline tag8_t state_of(packed64_t p) noexcept {
+        return PackedCell::st_from_strel(PackedCell::extract_strel(p));
+    }
+
+    static inline packed64_t as_published(packed64_t item) noexcept {
+        return PackedCell::set_strel(item, make_strel(ST_PUBLISHED, PackedCell::rel_from_strel(PackedCell::extract_strel(item))));
+    }
+
+    static inline packed64_t make_idle() noexcept {
+        if constexpr (MODE == PackedMode::MODE_VALUE32)
+            return PackedCell::compose_value32(val32_t(0), clk16_t(0), ST_IDLE, tag8_t(0));
+        else
+            return PackedCell::compose_clk48(clk48_t(0), ST_IDLE, tag8_t(0));
+    }
+
+    int fd_{-1};
+    void* base_{nullptr};
+    size_t bytes_{0};
+    size_t capacity_{0};
+    ShmMailboxHeader* hdr_{nullptr};
+    std::atomic<packed64_t>* cells_{nullptr};
+    std::string created_name_; // set only while a CREATE of a named segment is in progress
+};
+
+#endif // __linux__
+
+} // namespace AtomicCScompact
+#pragma once
+// AtomicPCArray.hpp
+// Single-array-of-64bit-atomics. Exposes auto pack/unpack helpers and
+// a page/region relation index to look up ranges quickly by relation bitmask.
+
+#include <algorithm>
+#include <atomic>
+#include <span>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <functional>
+#include <memory>
+#include <bit>
+#include <string>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__unix__)
+    #include <cerrno>
+    #include <cstring>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "AllocNW.hpp"
+
+namespace AtomicCScompact {
+
+// One cell of a multi-cell compare-and-swap (AtomicPCArray::kcas)
+struct KcasEntry {
+    size_t idx;
+    packed64_t expected;
+    packed64_t desired;
+};
+
+// What AtomicPCArray::epoch_bump does to each cell of a drained region
+enum class EpochBump : int {
+    ADVANCE = 0, // clk16 (or clk48) += delta, wrapping within the field
+    REBASE  = 1  // clk16 (or clk48) := 0; region_epoch() carries the rolled-over part
+};
+
+// epoch_bump waits at most timeout_ms (default below; < 0 waits forever) for a bump already
+// running on the region, for announced threads to leave, and for ST_PENDING / kcas / RLU cells
+// in the region to resolve. Results:
+//   region's cell count : every cell rewritten, region_epoch() advanced
+//   SIZE_MAX            : expired while draining; nothing rewritten, region and epoch unchanged
+//   anything smaller    : a writer that does not announce held cells past the deadline after
+//                         the rewrite began; those cells kept their clock, the rest were
+//                         rewritten and region_epoch() advanced
+inline constexpr int EPOCH_BUMP_WAIT_MS = 1000;
+
+// On-disk layout of a file-backed AtomicPCArray: this header, padded to one page, then n cells.
+// VERSION changes whenever the packed st/rel/value layout does.
+struct PCFileHeader {
+    static inline constexpr uint64_t MAGIC = 0x3141435043534341ull; // "ACSCPCA1"
+    static inline constexpr uint32_t VERSION = 1;
+    uint64_t magic;
+    uint32_t version;
+    uint32_t mode;
+    uint64_t n;
+    uint32_t cell_bytes;
+    uint32_t reserved;
+    uint64_t data_offset;
+};
+
+// WAIT: wait/backoff policy for the blocking waits (see WaitStrategy.hpp)
+// STATS: NoStats or ContentionStats (see HotPathStats.hpp)
+template<PackedMode MODE, class WAIT = ParkWait, class STATS = NoStats>
+class AtomicPCArray {
+public:
+    using packed_t = packed64_t;
+    AtomicPCArray() noexcept : n_(0), meta_(nullptr), owned_bytes_(0), region_size_(0) {}
+    ~AtomicPCArray() { free_all(); }
+
+    void init_on_node(size_t n, int node, size_t alignment = 64) {
+        AllocNW::AllocOptions opt;
+        opt.node = node;
+        init_on_node(n, opt, alignment);
+    }
+
+    // opt: page size (THP / 2M / 1G hugetlb), NUMA policy and prefault for the cell array.
+    // Cells come up idle from the allocator's zero pages, so this is O(1) unless opt.populate
+    // asks for a (parallel, node-pinned) first touch.
+    void init_on_node(size_t n, const AllocNW::AllocOptions &opt, size_t alignment = 64) {
+        free_all();
+        if (n == 0) throw std::invalid_argument("n==0");
+        std::atomic<packed_t> test{0};
+        if (!test.is_lock_free()) throw std::runtime_error("atomic<packed_t> not lock-free");
+        n_ = n;
+        owned_bytes_ = sizeof(std::atomic<packed_t>) * n_;
+        void* p = AllocNW::Alloc(owned_bytes_, opt, alignment);
+        alloc_ = opt;
+        align_ = alignment;
+        node_ = opt.node;
+        meta_ = reinterpret_cast<std::atomic<packed_t>*>(p); // zero-filled == idle
+        stats_.init(n_);
+    }
+
+    void init_from_existing(std::atomic<packed_t>* backing, size_t n) {
+        free_all();
+        if (!backing) throw std::invalid_argument("backing==nullptr");
+        n_ = n;
+        meta_ = backing;
+        owned_bytes_ = 0;
+        stats_.init(n_);
+    }
+
+#if defined(__unix__)
+    // init_from_file: map path MAP_SHARED as the cell array. A new or empty file is sized and
+    // filled with idle cells; an existing one must carry a header matching MODE, n and
+    // PCFileHeader::VERSION, and its cells are used as-is (warm restart). node >= 0 prefaults
+    // the cells under a preferred-node policy so page-cache pages land there (pages already
+    // cached elsewhere stay put). Throws on I/O errors or header mismatch.
+    void init_from_file(const std::string &path, size_t n, int node = -1) {
+        free_all();
+        if (n == 0) throw std::invalid_argument("n==0");
+        const size_t data_off = AllocNW::PageSize();
+        const size_t bytes = data_off + sizeof(std::atomic<packed_t>) * n;
+
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) throw std::runtime_error("open " + path + ": " + std::strerror(errno));
+        struct stat sb;
+        if (::fstat(fd, &sb) != 0) { ::close(fd); throw std::runtime_error("fstat " + path + ": " + std::strerror(errno)); }
+        const bool fresh = sb.st_size == 0;
+        if (fresh && ::ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+            ::close(fd);
+            throw std::runtime_error("ftruncate " + path + ": " + std::strerror(errno));
+        }
+        if (!fresh && static_cast<size_t>(sb.st_size) != bytes) {
+            ::close(fd);
+            throw std::runtime_error(path + ": size does not match n");
+        }
+        void* base = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) { ::close(fd); throw std::runtime_error("mmap " + path + ": " + std::strerror(errno)); }
+
+        auto* hdr = static_cast<PCFileHeader*>(base);
+        if (!fresh) {
+            const char* bad = nullptr;
+            if (hdr->magic != PCFileHeader::MAGIC) bad = "bad magic";
+            else if (hdr->version != PCFileHeader::VERSION) bad = "layout version mismatch";
+            else if (hdr->mode != static_cast<uint32_t>(MODE)) bad = "PackedMode mismatch";
+            else if (hdr->n != n || hdr->cell_bytes != sizeof(packed_t) || hdr->data_offset != data_off) bad = "geometry mismatch";
+            if (bad) {
+                ::munmap(base, bytes);
+                ::close(fd);
+                throw std::runtime_error(path + ": " + bad);
+            }
+        }
+        map_base_ = base;
+        map_bytes_ = bytes;
+        map_fd_ = fd;
+        n_ = n;
+        meta_ = reinterpret_cast<std::atomic<packed_t>*>(static_cast<char*>(base) + data_off);
+        node_ = node;
+        if (node >= 0) prefault_on_node(node);
+        if (fresh) {
+            // cells are idle already (ftruncate zero-fills); magic last: a crash mid-init leaves
+            // a file that fails validation
+            hdr->version = PCFileHeader::VERSION;
+            hdr->mode = static_cast<uint32_t>(MODE);
+            hdr->n = n;
+            hdr->cell_bytes = sizeof(packed_t);
+            hdr->reserved = 0;
+            hdr->data_offset = data_off;
+            checkpoint();
+            hdr->magic = PCFileHeader::MAGIC;
+            checkpoint_bytes(0, data_off, false);
+        }
+        stats_.init(n_);
+    }
+
+    // checkpoint: write dirty pages of the mapping back to the file (msync; only pages the
+    // kernel tracks as dirty are written). async = MS_ASYNC: schedule without waiting.
+    void checkpoint(bool async = false) {
+        if (map_base_) checkpoint_bytes(0, map_bytes_, async);
+    }
+
+    // checkpoint cells [begin, end) only (rounded out to whole pages)
+    void checkpoint_range(size_t begin, size_t end, bool async = false) {
+        if (!map_base_ || begin >= end || begin >= n_) return;
+        const size_t off = reinterpret_cast<char*>(meta_) - static_cast<char*>(map_base_);
+        checkpoint_bytes(off + begin * sizeof(packed_t), off + std::min(end, n_) * sizeof(packed_t), async);
+    }
+#endif
+
+    bool file_backed() const noexcept { return map_base_ != nullptr; }
+
+    void free_all() noexcept {
+        if (meta_) {
+            if (owned_bytes_ != 0) AllocNW::Free(static_cast<void*>(meta_), owned_bytes_, alloc_, align_);
+            meta_ = nullptr;
+        }
+#if defined(__unix__)
+        if (map_base_) {
+            ::munmap(map_base_, map_bytes_); // dirty pages still reach the file via writeback
+            ::close(map_fd_);
+        }
+#endif
+        map_base_ = nullptr;
+        map_bytes_ = 0;
+        map_fd_ = -1;
+        n_ = 0;
+        owned_bytes_ = 0;
+        region_size_ = 0;
+        num_regions_ = 0;
+        region_rel_.reset();
+        region_cnt_.reset();
+        snap_cells_ = 0;
+        num_snap_ = 0;
+        snap_ver_.reset();
+        num_kcas_ = 0;
+        kcas_desc_.reset();
+        epoch_cells_ = 0;
+        num_epoch_regions_ = 0;
+        region_bump_.reset();
+        num_epoch_slots_ = 0;
+        epoch_slot_.reset();
+    }
+
+    size_t size() const noexcept { return n_; }
+
+    // contention counters (all zero unless STATS = ContentionStats); heat covers the cell range
+    StatsSnapshot stats() const { return stats_.snapshot(); }
+    void reset_stats() noexcept { stats_.reset(); }
+
+    // read / store helpers
+    packed_t load(size_t idx, std::memory_order mo = std::memory_order_acquire) const noexcept {
+        if (idx >= n_) return packed_t(0);
+        return meta_[idx].load(mo);
+    }
+    // with a region index the store becomes an exchange so the old rel can be accounted
+    void store(size_t idx, packed_t v, std::memory_order mo = std::memory_order_release) noexcept {
+        if (idx >= n_) return;
+        SnapVersion* sv = snap_write_begin(idx);
+        if (region_size_) account_rel(idx, meta_[idx].exchange(v, mo), v);
+        else meta_[idx].store(v, mo);
+        snap_write_end(sv);
+        notify_slot(idx);
+    }
+    bool compare_exchange(size_t idx, packed_t &expected, packed_t desired) noexcept {
         if (idx >= n_) return false;
-        return meta_[idx].compare_exchange_strong(expected, desired, std::memory_order_acq_rel, std::memory_order_relaxed);
+        SnapVersion* sv = snap_write_begin(idx);
+        bool ok = meta_[idx].compare_exchange_strong(expected, desired, std::memory_order_acq_rel, std::memory_order_relaxed);
+        snap_write_end(sv);
+        if (!ok) {
+            stats_.cas_fail(idx);
+            return false;
+        }
+        account_rel(idx, expected, desired);
+        return true;
     }
 
     // high-level helpers auto pack/unpack so user rarely calls compose manually
@@ -533,109 +2884,431 @@ public:
     }
 
     // reserve/commit helpers (CAS-based)
-    bool reserve_for_update(size_t idx, packed_t expected, uint16_t batch_low, tag8_t rel_hint) noexcept {
-        // build pending packed based on observed expected
-        packed_t pending;
+    // make_pending: the exact packed word reserve_for_update installs for an observed value.
+    packed_t make_pending(packed_t expected, uint16_t batch_low, tag8_t rel_hint) const noexcept {
         if constexpr (MODE == PackedMode::MODE_VALUE32) {
             val32_t v = PackedCell::extract_value32(expected);
-            pending = PackedCell::compose_value32(v, static_cast<clk16_t>(batch_low), ST_PENDING, rel_hint);
+            return PackedCell::compose_value32(v, static_cast<clk16_t>(batch_low), ST_PENDING, rel_hint);
         } else {
             clk48_t c = PackedCell::extract_clk48(expected);
-            pending = PackedCell::compose_clk48(c, ST_PENDING, rel_hint);
+            return PackedCell::compose_clk48(c, ST_PENDING, rel_hint);
         }
+    }
+
+    bool reserve_for_update(size_t idx, packed_t expected, uint16_t batch_low, tag8_t rel_hint) noexcept {
+        // build pending packed based on observed expected
+        packed_t pending = make_pending(expected, batch_low, rel_hint);
         packed_t exp = expected;
         return compare_exchange(idx, exp, pending);
     }
 
     bool commit_update(size_t idx, packed_t expected_pending, packed_t committed) noexcept {
         bool ok = compare_exchange(idx, expected_pending, committed);
-        if (ok) std::atomic_notify_all(&meta_[idx]);
+        if (ok) notify_slot(idx);
         return ok;
     }
 
-    // region/rel index: page-based mapping for fast lookup of slots matching a relation mask.
-    // init_region(size) splits array into regions of region_size and keeps an OR-rel mask per region.
-    void init_region_index(size_t region_size) {
-        if (region_size == 0) throw std::invalid_argument("region_size==0");
-        region_size_ = region_size;
-        num_regions_ = (n_ + region_size_ - 1) / region_size_;
-        region_rel_.assign(num_regions_, static_cast<tag8_t>(0));
-        // populate initial region_rel_
-        for (size_t r = 0; r < num_regions_; ++r) {
-            size_t base = r * region_size_;
-            size_t end = std::min(n_, base + region_size_);
-            tag8_t accum = 0;
-            for (size_t i = base; i < end; ++i) {
-                packed_t p = load(i);
-                accum |= PackedCell::rel_from_strel(PackedCell::extract_strel(p));
+    // read_payload: copy payload idx (see PayloadArray) without holding the cell. Succeeds when
+    // the cell is not ST_PENDING and its word is unchanged across the copy, so writers (between
+    // reserve_for_update and commit_update) must commit a different word each time, e.g. a
+    // bumped clock. observed receives the word the copy is consistent with.
+    template<class T>
+    bool read_payload(size_t idx, const PayloadArray<T> &payloads, T &out, packed_t *observed = nullptr) const noexcept {
+        static_assert(std::is_trivially_copyable_v<T>, "read_payload copies T bytewise");
+        if (idx >= n_ || idx >= payloads.size()) return false;
+        packed_t before = meta_[idx].load(std::memory_order_acquire);
+        if (PackedCell::st_from_strel(PackedCell::extract_strel(before)) == ST_PENDING) return false;
+        std::memcpy(static_cast<void*>(&out), static_cast<const void*>(&payloads[idx]), sizeof(T));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (meta_[idx].load(std::memory_order_relaxed) != before) return false;
+        if (observed) *observed = before;
+        return true;
+    }
+
+    // region/rel index: page-based mapping for fast lookup of slots matching a relation mask.
+    // init_region(size) splits array into regions of region_size and keeps an OR-rel mask per region.
+    // Each mask bit is backed by a count of cells in the region carrying that rel bit, so the
+    // mask shrinks when the last matching cell leaves. Every mutating helper keeps it exact;
+    // call init_region_index before concurrent writers start.
+    void init_region_index(size_t region_size) {
+        if (region_size == 0) throw std::invalid_argument("region_size==0");
+        if (region_size > UINT32_MAX) throw std::invalid_argument("region_size exceeds 32-bit counters");
+        region_size_ = 0; // stop accounting while the tables are rebuilt
+        num_regions_ = (n_ + region_size - 1) / region_size;
+        region_rel_.reset(new std::atomic<tag8_t>[num_regions_]);
+        region_cnt_.reset(new std::atomic<uint32_t>[num_regions_ * 8]);
+        for (size_t r = 0; r < num_regions_; ++r) {
+            size_t base = r * region_size;
+            size_t end = std::min(n_, base + region_size);
+            uint32_t cnt[8] = {};
+            for (size_t i = base; i < end; ++i) {
+                tag8_t rl = PackedCell::rel_from_strel(PackedCell::extract_strel(load(i)));
+                for (unsigned b = 0; b < 8; ++b) cnt[b] += (rl >> b) & 1u;
+            }
+            tag8_t accum = 0;
+            for (unsigned b = 0; b < 8; ++b) {
+                region_cnt_[r * 8 + b].store(cnt[b], std::memory_order_relaxed);
+                if (cnt[b]) accum |= static_cast<tag8_t>(1u << b);
+            }
+            region_rel_[r].store(accum, std::memory_order_relaxed);
+        }
+        region_size_ = region_size;
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    // current OR-rel mask of a region (0 if no index or out of range)
+    tag8_t region_rel(size_t r) const noexcept {
+        return (region_size_ && r < num_regions_) ? region_rel_[r].load(std::memory_order_acquire) : tag8_t(0);
+    }
+
+    // update a single slot's relation hint; the CAS loop lets the region index see the exact old rel
+    void update_rel_hint(size_t idx, tag8_t rel) noexcept {
+        if (idx >= n_) return;
+        packed_t p = load(idx);
+        while (!compare_exchange(idx, p, PackedCell::set_rel(p, rel))) {}
+        notify_slot(idx);
+    }
+
+    // query ranges for a rel_mask: uses region index to speed up (page-based)
+    // cells are tested in SIMD blocks (PackedScan); runs never span a region boundary
+    std::vector<std::pair<size_t,size_t>> scan_rel_ranges(tag8_t rel_mask) const noexcept {
+        std::vector<std::pair<size_t,size_t>> out;
+        if (n_ == 0) return out;
+        if (region_size_ == 0) {
+            // fallback linear scan
+            PackedScan::rel_ranges(meta_, 0, n_, rel_mask, out);
+            return out;
+        }
+        // region-accelerated
+        for (size_t r = 0; r < num_regions_; ++r) {
+            tag8_t rr = region_rel_[r].load(std::memory_order_acquire);
+            if ((rr & rel_mask) == 0) continue;
+            size_t base = r * region_size_;
+            size_t end  = std::min(n_, base + region_size_);
+            PackedScan::rel_ranges(meta_, base, end, rel_mask, out);
+        }
+        return out;
+    }
+
+    // snapshot versions: one begin/end write counter pair per region of region_cells cells.
+    // Every mutating helper bumps begin, writes, bumps end, so snapshot() can validate a quiet
+    // region with two counter loads instead of re-reading its cells, and without relying on
+    // writers changing the cell word. Costs writers two uncontended-per-region RMWs; call
+    // before concurrent writers start.
+    void init_snapshot_versions(size_t region_cells) {
+        if (region_cells == 0) throw std::invalid_argument("region_cells==0");
+        snap_cells_ = 0;
+        num_snap_ = (n_ + region_cells - 1) / region_cells;
+        snap_ver_.reset(new SnapVersion[num_snap_]);
+        snap_cells_ = region_cells;
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    // snapshot: consistent copy of cells [begin, end) into out (end - begin entries) without
+    // blocking writers: bulk copy, then validate and re-copy only what changed until one pass
+    // finds nothing changed; the copy is then the range's state at a single instant. Regions
+    // with snapshot versions validate by counter; elsewhere cells validate by word, so writers
+    // must change the word on every update (the clk16/clk48 bump does; clk16 wraps after 65536
+    // updates of one cell within a pass). Returns false if the range was still changing after
+    // max_rounds validation passes (out then holds a possibly torn copy).
+    bool snapshot(size_t begin, size_t end, packed_t* out, unsigned max_rounds = 16) const noexcept {
+        end = std::min(end, n_);
+        if (begin >= end) return true;
+        if (snap_cells_) return snapshot_versioned(begin, end, out, max_rounds);
+        const packed_t* live = PackedScan::raw_view(meta_);
+        std::memcpy(out, live + begin, (end - begin) * sizeof(packed_t));
+        for (unsigned round = 0; round < max_rounds; ++round) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            bool changed = false;
+            for (size_t b = begin; b < end; b += SNAP_BLOCK) {
+                const size_t len = std::min(SNAP_BLOCK, end - b);
+                packed_t* o = out + (b - begin);
+                if (std::memcmp(o, live + b, len * sizeof(packed_t)) == 0) continue;
+                for (size_t i = 0; i < len; ++i) {
+                    packed_t v = meta_[b + i].load(std::memory_order_relaxed);
+                    if (v != o[i]) { o[i] = v; changed = true; }
+                }
+            }
+            if (!changed) return true;
+        }
+        return false;
+    }
+
+    bool snapshot(size_t begin, size_t end, std::vector<packed_t> &out, unsigned max_rounds = 16) const {
+        end = std::min(end, n_);
+        out.resize(begin < end ? end - begin : 0);
+        return snapshot(begin, end, out.data(), max_rounds);
+    }
+
+    // Multi-cell CAS. An op publishes a descriptor, then takes its cells in index order by
+    // swapping each expected word for an ST_LOCKED marker (descriptor id + sequence, rel kept),
+    // decides with one CAS on the descriptor status and writes the outcome back. A thread that
+    // meets a marker helps: a decided op's cell is finished for it, an undecided one is given a
+    // short grace period and then aborted. Cells no op touches cost readers nothing; ST_LOCKED
+    // is reserved for these markers.
+    static inline constexpr size_t KCAS_MAX = 8;
+
+    // init_kcas: descriptor pool; at most `descriptors` kcas calls run at once, more wait for a
+    // free descriptor. Call before concurrent kcas callers start.
+    void init_kcas(size_t descriptors = 256) {
+        if (descriptors == 0 || descriptors > KCAS_MAX_DESC) throw std::invalid_argument("descriptors must be 1..4096");
+        num_kcas_ = 0;
+        kcas_desc_.reset(new KcasDesc[descriptors]);
+        num_kcas_ = descriptors;
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    // kcas: if every entry's cell holds its expected word, replace them all with the desired
+    // words at one instant and return true; otherwise change nothing and return false. Up to
+    // KCAS_MAX entries with distinct indices; expected/desired must not be ST_LOCKED. While an
+    // op is in flight load() shows its markers and load_resolved() the logical value. Cells
+    // used with kcas must otherwise change only through helpers that CAS against a plain
+    // expected word (reserve_for_update, commit_update, compare_exchange); store() would
+    // overwrite a marker.
+    bool kcas(std::span<const KcasEntry> entries) noexcept {
+        const size_t k = entries.size();
+        if (k == 0) return true;
+        if (k > KCAS_MAX || num_kcas_ == 0) return false;
+        KcasEntry e[KCAS_MAX];
+        for (size_t i = 0; i < k; ++i) {
+            e[i] = entries[i];
+            if (e[i].idx >= n_ || is_kcas_marker(e[i].expected) || is_kcas_marker(e[i].desired)) return false;
+        }
+        // ascending idx (insertion: k <= KCAS_MAX; std::sort trips -Warray-bounds for constant k)
+        for (size_t i = 1; i < k; ++i) {
+            const KcasEntry x = e[i];
+            size_t j = i;
+            for (; j > 0 && e[j - 1].idx > x.idx; --j) e[j] = e[j - 1];
+            e[j] = x;
+        }
+        for (size_t i = 1; i < k; ++i) if (e[i].idx == e[i - 1].idx) return false;
+
+        // publish the descriptor (seqlock: PREP while the entries are rewritten)
+        const uint32_t id = kcas_acquire();
+        KcasDesc &d = kcas_desc_[id];
+        const uint64_t seq = ((d.status.load(std::memory_order_relaxed) >> 2) + 1) & KCAS_SEQ_MASK;
+        d.status.store(seq << 2 | KCAS_PREP, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        d.k.store(static_cast<uint32_t>(k), std::memory_order_relaxed);
+        for (size_t i = 0; i < k; ++i) {
+            d.idx[i].store(e[i].idx, std::memory_order_relaxed);
+            d.expected[i].store(e[i].expected, std::memory_order_relaxed);
+            d.desired[i].store(e[i].desired, std::memory_order_relaxed);
+        }
+        d.status.store(seq << 2 | KCAS_UNDECIDED, std::memory_order_release);
+
+        // take the cells in index order; stop on a mismatch or once a helper aborted us
+        size_t owned = 0;
+        for (; owned < k; ++owned) {
+            const size_t idx = e[owned].idx;
+            const packed_t mark = kcas_marker(id, seq, e[owned].expected);
+            bool ok = false;
+            for (unsigned round = 0; (d.status.load(std::memory_order_acquire) & 3) == KCAS_UNDECIDED; ++round) {
+                packed_t cur = meta_[idx].load(std::memory_order_acquire);
+                if (cur == e[owned].expected) {
+                    if (compare_exchange(idx, cur, mark)) { ok = true; break; }
+                    continue;
+                }
+                if (!is_kcas_marker(cur)) break;
+                if (!kcas_help(idx, cur, round) && meta_[idx].load(std::memory_order_acquire) == cur) break;
+            }
+            if (!ok) break;
+        }
+        uint64_t undecided = seq << 2 | KCAS_UNDECIDED;
+        d.status.compare_exchange_strong(undecided, seq << 2 | (owned == k ? KCAS_SUCCEEDED : KCAS_FAILED),
+                                         std::memory_order_acq_rel, std::memory_order_acquire);
+        const bool won = (d.status.load(std::memory_order_acquire) & 3) == KCAS_SUCCEEDED;
+
+        // write the outcome over whatever markers are left (helpers may have done some); this
+        // also clears a marker installed after an abort, so none survive the descriptor's reuse
+        for (size_t i = 0; i < k; ++i) {
+            packed_t cur = meta_[e[i].idx].load(std::memory_order_acquire);
+            while (is_kcas_marker_of(cur, id, seq) && !compare_exchange(e[i].idx, cur, won ? e[i].desired : e[i].expected)) {}
+            if (won) notify_slot(e[i].idx);
+        }
+        d.busy.store(0, std::memory_order_release);
+        return won;
+    }
+
+    // load_resolved: like load(), but a cell held by an in-flight kcas reads as its logical
+    // value (desired once the op succeeded, expected before)
+    packed_t load_resolved(size_t idx) const noexcept {
+        if (idx >= n_) return packed_t(0);
+        while (true) {
+            packed_t cur = meta_[idx].load(std::memory_order_acquire);
+            if (!is_kcas_marker(cur)) return cur;
+            KcasView v;
+            if (kcas_view(idx, cur, v)) return v.state == KCAS_SUCCEEDED ? v.desired : v.expected;
+            if (meta_[idx].load(std::memory_order_acquire) == cur) return cur; // not a kcas marker
+        }
+    }
+
+    // Region epochs. A bump rewrites the clock of every cell in one region while the rest of the
+    // array keeps running. Threads bracket multi-step work on a region (reserve_for_update ..
+    // commit_update, a claim .. its commit) with epoch_enter/epoch_exit, which announces the
+    // region in the thread's own slot. epoch_bump marks the region ST_EPOCH_BUMP, waits until no
+    // slot announces it (new entrants back off until the bump is over), then advances the cells
+    // with one CAS each. Single-CAS writers (compare_exchange, update_rel_hint, committers) stay
+    // correct without announcing. ST_PENDING and marker cells still in the region belong to
+    // owners that did not announce (or to kcas/RLU ops in flight); the bump waits for them.
+    // Call init_region_epochs before concurrent users start.
+    void init_region_epochs(size_t region_cells, size_t max_threads = 64) {
+        if (region_cells == 0) throw std::invalid_argument("region_cells==0");
+        if (max_threads == 0) throw std::invalid_argument("max_threads==0");
+        epoch_cells_ = 0;
+        num_epoch_regions_ = (n_ + region_cells - 1) / region_cells;
+        region_bump_.reset(new std::atomic<uint64_t>[num_epoch_regions_]);
+        for (size_t r = 0; r < num_epoch_regions_; ++r) region_bump_[r].store(0, std::memory_order_relaxed);
+        epoch_slot_.reset(new EpochSlot[max_threads]);
+        num_epoch_slots_ = max_threads;
+        epoch_cells_ = region_cells;
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    bool region_epochs() const noexcept { return epoch_cells_ != 0; }
+    size_t epoch_region_of(size_t idx) const noexcept { return epoch_cells_ ? idx / epoch_cells_ : 0; }
+
+    // bumps completed on region r
+    uint64_t region_epoch(size_t r) const noexcept {
+        return r < num_epoch_regions_ ? region_bump_[r].load(std::memory_order_acquire) >> 8 : 0;
+    }
+
+    // epoch_register: claim an announcement slot for the calling thread. Throws when all
+    // max_threads slots are taken.
+    uint32_t epoch_register() {
+        uint32_t t = try_epoch_register();
+        if (t == UINT32_MAX) throw std::runtime_error("AtomicPCArray: all epoch slots in use");
+        return t;
+    }
+    // try_epoch_register: as above, UINT32_MAX when every slot is taken
+    uint32_t try_epoch_register() noexcept {
+        for (size_t i = 0; i < num_epoch_slots_; ++i) {
+            bool expected = false;
+            if (epoch_slot_[i].used.compare_exchange_strong(expected, true, std::memory_order_acquire, std::memory_order_relaxed))
+                return static_cast<uint32_t>(i);
+        }
+        return UINT32_MAX;
+    }
+    void epoch_unregister(uint32_t t) noexcept {
+        epoch_slot_[t].region.store(0, std::memory_order_release);
+        epoch_slot_[t].used.store(false, std::memory_order_release);
+    }
+
+    // try_epoch_enter: announce idx's region for thread t; false (nothing announced) while that
+    // region is being bumped. One region per thread at a time.
+    bool try_epoch_enter(uint32_t t, size_t idx) noexcept {
+        if (epoch_cells_ == 0 || idx >= n_) return true;
+        const size_t r = idx / epoch_cells_;
+        EpochSlot &s = epoch_slot_[t];
+        s.region.store(r + 1, std::memory_order_seq_cst);
+        if (!is_bumping(region_bump_[r].load(std::memory_order_seq_cst))) return true;
+        s.region.store(0, std::memory_order_release);
+        return false;
+    }
+
+    // epoch_enter: try_epoch_enter, waiting out a bump in progress
+    void epoch_enter(uint32_t t, size_t idx) noexcept {
+        for (unsigned round = 0; !try_epoch_enter(t, idx); ++round) WAIT::pause(round);
+    }
+
+    void epoch_exit(uint32_t t) noexcept {
+        if (epoch_cells_) epoch_slot_[t].region.store(0, std::memory_order_release);
+    }
+
+    // epoch_bump: drain region r and rewrite its cells' clocks per kind; status, value and rel
+    // are untouched. Concurrent bumps of one region run one after the other. Must not be called
+    // while the caller itself announces r, and a reservation, kcas or RLU lock the caller holds
+    // in r just runs it into the deadline. Returns the number of cells rewritten or SIZE_MAX
+    // (see EPOCH_BUMP_WAIT_MS).
+    size_t epoch_bump(size_t r, EpochBump kind = EpochBump::ADVANCE, uint64_t delta = 1,
+                      int timeout_ms = EPOCH_BUMP_WAIT_MS) noexcept {
+        if (epoch_cells_ == 0 || r >= num_epoch_regions_) return 0;
+        const bool has_deadline = timeout_ms >= 0;
+        const FutexWait::Deadline d = FutexWait::deadline_after(timeout_ms);
+        auto expired = [&]() noexcept { return has_deadline && std::chrono::steady_clock::now() >= d; };
+        std::atomic<uint64_t> &word = region_bump_[r];
+        uint64_t cur = word.load(std::memory_order_relaxed);
+        for (unsigned round = 0;; ++round) {
+            if (is_bumping(cur)) {
+                if (expired()) return SIZE_MAX;
+                WAIT::pause(round);
+                cur = word.load(std::memory_order_relaxed);
+                continue;
             }
-            region_rel_[r] = accum;
+            if (word.compare_exchange_weak(cur, (cur & ~uint64_t(0xFF)) | ST_EPOCH_BUMP,
+                                           std::memory_order_seq_cst, std::memory_order_relaxed)) break;
         }
-    }
+        auto unresolved = [](packed_t p) noexcept {
+            const tag8_t st = PackedCell::st_from_strel(PackedCell::extract_strel(p));
+            return st == ST_PENDING || st == ST_LOCKED || st == ST_RLU_LOCKED;
+        };
+        const size_t base = r * epoch_cells_, end = std::min(n_, base + epoch_cells_);
 
-    // update a single slot's relation hint and update region table (atomic in-store then region OR)
-    void update_rel_hint(size_t idx, tag8_t rel) noexcept {
-        if (idx >= n_) return;
-        packed_t p = load(idx);
-        // set top-rel bits efficiently
-        packed_t newp = PackedCell::set_rel(p, rel);
-        store(idx, newp);
-        if (region_size_) {
-            size_t r = idx / region_size_;
-            // atomic OR: single byte region_rel_ not atomic, but it's a best-effort hint;
-            // we update with a simple fetch_or on 32-bit to avoid heavy locking.
-            // Use compare_exchange loop to be safe and portable:
-            tag8_t cur = region_rel_[r];
-            tag8_t want = static_cast<tag8_t>(cur | rel);
-            region_rel_[r] = want;
+        // grace period: every thread that announced r before the mark has left, then every
+        // reservation or marker still in the region has resolved. Expiry drops the mark.
+        for (size_t i = 0; i < num_epoch_slots_; ++i) {
+            const EpochSlot &s = epoch_slot_[i];
+            for (unsigned round = 0; s.region.load(std::memory_order_seq_cst) == r + 1; ++round) {
+                if (expired()) { word.store(cur, std::memory_order_release); return SIZE_MAX; }
+                WAIT::pause(round);
+            }
         }
-    }
-
-    // query ranges for a rel_mask: uses region index to speed up (page-based)
-    std::vector<std::pair<size_t,size_t>> scan_rel_ranges(tag8_t rel_mask) const noexcept {
-        std::vector<std::pair<size_t,size_t>> out;
-        if (n_ == 0) return out;
-        if (region_size_ == 0) {
-            // fallback linear scan
-            size_t i = 0;
-            while (i < n_) {
-                packed_t p = load(i);
-                tag8_t r = PackedCell::rel_from_strel(PackedCell::extract_strel(p));
-                if (!rel_matches(r, rel_mask)) { ++i; continue; }
-                size_t s = i++;
-                while (i < n_) {
-                    p = load(i);
-                    if (!rel_matches(PackedCell::rel_from_strel(PackedCell::extract_strel(p)), rel_mask)) break;
-                    ++i;
-                }
-                out.emplace_back(s, i - s);
+        for (size_t i = base; i < end; ++i) {
+            for (unsigned round = 0; unresolved(meta_[i].load(std::memory_order_acquire)); ++round) {
+                if (expired()) { word.store(cur, std::memory_order_release); return SIZE_MAX; }
+                WAIT::pause(round);
             }
-            return out;
         }
-        // region-accelerated
-        size_t r = 0;
-        while (r < num_regions_) {
-            tag8_t rr = region_rel_[r];
-            if ((rr & rel_mask) == 0) { ++r; continue; }
-            // probe region element-by-element to find contiguous runs
-            size_t base = r * region_size_;
-            size_t end  = std::min(n_, base + region_size_);
-            size_t i = base;
-            while (i < end) {
-                packed_t p = load(i);
-                tag8_t rl = PackedCell::rel_from_strel(PackedCell::extract_strel(p));
-                if (!rel_matches(rl, rel_mask)) { ++i; continue; }
-                size_t s = i++;
-                while (i < end) {
-                    p = load(i);
-                    if (!rel_matches(PackedCell::rel_from_strel(PackedCell::extract_strel(p)), rel_mask)) break;
-                    ++i;
+
+        size_t bumped = 0;
+        SnapVersion* sv = nullptr;
+        for (size_t i = base; i < end; ++i) {
+            packed_t p = meta_[i].load(std::memory_order_relaxed);
+            for (unsigned round = 0;;) {
+                if (unresolved(p)) {
+                    // a writer that does not announce got in after the drain: wait for it
+                    // outside the snapshot window, and leave the cell alone past the deadline
+                    snap_write_end(sv);
+                    sv = nullptr;
+                    if (expired()) break;
+                    WAIT::pause(round++);
+                    p = meta_[i].load(std::memory_order_acquire);
+                    continue;
+                }
+                if (snap_cells_ && sv != &snap_ver_[i / snap_cells_]) {
+                    snap_write_end(sv);
+                    sv = snap_write_begin(i);
+                }
+                if (meta_[i].compare_exchange_weak(p, bumped_clock(p, kind, delta), std::memory_order_acq_rel,
+                                                   std::memory_order_relaxed)) {
+                    ++bumped;
+                    break;
                 }
-                out.emplace_back(s, i - s);
             }
-            ++r;
         }
-        return out;
+        snap_write_end(sv);
+        if constexpr (WAIT::parks) FutexWait::notify_range(meta_ + base, end - base);
+        word.store(((cur >> 8) + 1) << 8 | ST_IDLE, std::memory_order_release);
+        return bumped;
+    }
+
+    // blocking waits per WAIT (timeout_ms < 0 waits forever, 0 checks once)
+    bool wait_for_change(size_t idx, packed_t expected, int timeout_ms = -1) const noexcept {
+        if (idx >= n_) return false;
+        return WaitOps::until<WAIT>(&meta_[idx], [expected](packed_t v) { return v != expected; }, timeout_ms);
+    }
+
+    bool wait_until_state(size_t idx, tag8_t st, int timeout_ms = -1) const noexcept {
+        if (idx >= n_) return false;
+        return WaitOps::until<WAIT>(&meta_[idx], [st](packed_t v) { return PackedCell::st_from_strel(PackedCell::extract_strel(v)) == st; }, timeout_ms);
+    }
+
+    // wait until any of idxs reaches state st; returns that index, or SIZE_MAX on timeout
+    size_t wait_any_state(const std::vector<size_t> &idxs, tag8_t st, int timeout_ms = -1) const noexcept {
+        for (size_t i : idxs) if (i >= n_) return SIZE_MAX;
+        size_t k = WaitOps::any<WAIT>(meta_, idxs.data(), idxs.size(),
+            [st](packed_t v) { return PackedCell::st_from_strel(PackedCell::extract_strel(v)) == st; }, timeout_ms);
+        return k == SIZE_MAX ? SIZE_MAX : idxs[k];
     }
 
     // helpers to set single slot to idle
@@ -654,6 +3327,12 @@ public:
     }
 
 private:
+    // only parking waiters sleep on FutexWait buckets; polling policies need no wake-up
+    inline void notify_slot(size_t idx) noexcept {
+        if constexpr (WAIT::parks) FutexWait::notify(&meta_[idx]);
+        else (void)idx;
+    }
+
     inline packed_t make_idle() const noexcept {
         if constexpr (MODE == PackedMode::MODE_VALUE32)
             return PackedCell::compose_value32(val32_t(0), clk16_t(0), ST_IDLE, tag8_t(0));
@@ -661,17 +3340,934 @@ private:
             return PackedCell::compose_clk48(clk48_t(0), ST_IDLE, tag8_t(0));
     }
 
+#if defined(__unix__)
+    // msync [from, to) bytes of the mapping, widened to whole pages
+    void checkpoint_bytes(size_t from, size_t to, bool async) {
+        const size_t ps = AllocNW::PageSize();
+        from = from / ps * ps;
+        to = std::min(map_bytes_, (to + ps - 1) / ps * ps);
+        if (::msync(static_cast<char*>(map_base_) + from, to - from, async ? MS_ASYNC : MS_SYNC) != 0)
+            throw std::runtime_error(std::string("msync: ") + std::strerror(errno));
+    }
+
+    // MAP_SHARED file pages follow the faulting thread's policy, not mbind: fault them in
+    // once under a preferred-node policy, then put the caller's own policy back
+    void prefault_on_node(int node) {
+#if defined(HAVE_LIBNUMA)
+        if (numa_available() < 0 || node > numa_max_node()) return;
+        bitmask* saved = numa_allocate_nodemask();
+        int saved_mode = MPOL_DEFAULT;
+        if (get_mempolicy(&saved_mode, saved->maskp, saved->size + 1, nullptr, 0) != 0) {
+            numa_free_nodemask(saved);
+            return;
+        }
+        auto restore = [&]() noexcept {
+            set_mempolicy(saved_mode, saved->maskp, saved->size + 1);
+            numa_free_nodemask(saved);
+        };
+        numa_set_preferred(node);
+        try {
+            AllocNW::FirstTouch(meta_, n_ * sizeof(packed_t), node, 0, false);
+        } catch (...) {
+            restore();
+            throw;
+        }
+        restore();
+#else
+        (void)node;
+#endif
+    }
+#endif
+
     size_t n_{0};
     std::atomic<packed_t>* meta_{nullptr};
     size_t owned_bytes_{0};
 
-    // region index
+    // region index: OR-rel mask per region plus 8 per-rel-bit cell counts per region
+    inline void account_rel(size_t idx, packed_t oldp, packed_t newp) noexcept {
+        if (region_size_ == 0) return;
+        tag8_t o = PackedCell::rel_from_strel(PackedCell::extract_strel(oldp));
+        tag8_t n = PackedCell::rel_from_strel(PackedCell::extract_strel(newp));
+        if (o == n) return; // common path: rel unchanged, index untouched
+        size_t r = idx / region_size_;
+        std::atomic<uint32_t>* cnt = &region_cnt_[r * 8];
+        for (unsigned gone = static_cast<unsigned>(o & ~n); gone; gone &= gone - 1) {
+            unsigned b = static_cast<unsigned>(std::countr_zero(gone));
+            if (cnt[b].fetch_sub(1) != 1) continue;
+            // last carrier left: clear, then re-arm if another cell gained the bit meanwhile
+            tag8_t bit = static_cast<tag8_t>(1u << b);
+            region_rel_[r].fetch_and(static_cast<tag8_t>(~bit));
+            if (cnt[b].load() != 0) region_rel_[r].fetch_or(bit);
+        }
+        for (unsigned added = static_cast<unsigned>(n & ~o); added; added &= added - 1) {
+            unsigned b = static_cast<unsigned>(std::countr_zero(added));
+            if (cnt[b].fetch_add(1) == 0) region_rel_[r].fetch_or(static_cast<tag8_t>(1u << b));
+        }
+    }
+
     size_t region_size_{0};
     size_t num_regions_{0};
-    std::vector<tag8_t> region_rel_;
+    std::unique_ptr<std::atomic<tag8_t>[]> region_rel_;
+    std::unique_ptr<std::atomic<uint32_t>[]> region_cnt_;
+
+    // snapshot versions: multi-writer seqlock per region; begin == end means no write in flight
+    struct alignas(64) SnapVersion {
+        std::atomic<uint64_t> begin{0};
+        std::atomic<uint64_t> end{0};
+    };
+    static inline constexpr size_t SNAP_BLOCK = 64; // cells compared per memcmp
+    static inline constexpr uint64_t SNAP_UNSTABLE = ~uint64_t(0);
+
+    inline SnapVersion* snap_write_begin(size_t idx) noexcept {
+        if (snap_cells_ == 0) return nullptr;
+        SnapVersion* sv = &snap_ver_[idx / snap_cells_];
+        sv->begin.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release); // a reader that sees the cell sees begin
+        return sv;
+    }
+    static inline void snap_write_end(SnapVersion* sv) noexcept {
+        if (sv) sv->end.fetch_add(1, std::memory_order_release);
+    }
+
+    // seen[r] is the begin count a region's copy was taken under (SNAP_UNSTABLE: a write was in
+    // flight). A region passes when begin still equals it; failing regions are re-copied and
+    // every region is checked again, so all pass within one final pass.
+    bool snapshot_versioned(size_t begin, size_t end, packed_t* out, unsigned max_rounds) const noexcept {
+        const packed_t* live = PackedScan::raw_view(meta_);
+        const size_t r0 = begin / snap_cells_, r1 = (end - 1) / snap_cells_ + 1;
+        std::vector<uint64_t> seen(r1 - r0);
+        auto copy_region = [&](size_t r) {
+            const SnapVersion &v = snap_ver_[r];
+            uint64_t e = v.end.load(std::memory_order_acquire);
+            uint64_t b = v.begin.load(std::memory_order_acquire);
+            seen[r - r0] = b == e ? b : SNAP_UNSTABLE;
+            const size_t lo = std::max(begin, r * snap_cells_), hi = std::min(end, (r + 1) * snap_cells_);
+            std::memcpy(out + (lo - begin), live + lo, (hi - lo) * sizeof(packed_t));
+        };
+        for (size_t r = r0; r < r1; ++r) copy_region(r);
+        for (unsigned round = 0; round < max_rounds; ++round) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            bool changed = false;
+            for (size_t r = r0; r < r1; ++r) {
+                if (snap_ver_[r].begin.load(std::memory_order_relaxed) == seen[r - r0]) continue;
+                changed = true;
+                copy_region(r);
+            }
+            if (!changed) return true;
+            WAIT::pause(round);
+        }
+        return false;
+    }
+
+    size_t snap_cells_{0};
+    size_t num_snap_{0};
+    std::unique_ptr<SnapVersion[]> snap_ver_;
+
+    // kcas descriptors. status = seq << 2 | state; PREP while the owner rewrites the entries.
+    // Marker low 48 bits: sequence (36) << 12 | descriptor id (12).
+    static inline constexpr size_t KCAS_MAX_DESC = 4096;
+    static inline constexpr uint64_t KCAS_SEQ_MASK = low_mask(36);
+    static inline constexpr uint64_t KCAS_UNDECIDED = 0, KCAS_SUCCEEDED = 1, KCAS_FAILED = 2, KCAS_PREP = 3;
+    static inline constexpr unsigned KCAS_GRACE = 64; // helper rounds before aborting an undecided op
+
+    struct alignas(64) KcasDesc {
+        std::atomic<uint64_t> status{0};
+        std::atomic<uint32_t> busy{0};
+        std::atomic<uint32_t> k{0};
+        std::atomic<size_t> idx[KCAS_MAX]{};
+        std::atomic<packed_t> expected[KCAS_MAX]{};
+        std::atomic<packed_t> desired[KCAS_MAX]{};
+    };
+    struct KcasView {
+        uint32_t id;
+        uint64_t seq;
+        uint64_t state;
+        packed_t expected;
+        packed_t desired;
+    };
+
+    static inline bool is_kcas_marker(packed_t p) noexcept {
+        return PackedCell::st_from_strel(PackedCell::extract_strel(p)) == ST_LOCKED;
+    }
+    static inline bool is_kcas_marker_of(packed_t p, uint32_t id, uint64_t seq) noexcept {
+        return is_kcas_marker(p) && (p & low_mask(48)) == ((seq << 12) | id);
+    }
+    static inline packed_t kcas_marker(uint32_t id, uint64_t seq, packed_t expected) noexcept {
+        tag8_t rel = PackedCell::rel_from_strel(PackedCell::extract_strel(expected));
+        return PackedCell::set_strel((seq << 12) | id, make_strel(ST_LOCKED, rel));
+    }
+
+    uint32_t kcas_acquire() noexcept {
+        const size_t start = thread_stripe() * num_kcas_ / THREAD_STRIPES;
+        for (unsigned round = 0; ; ++round) {
+            for (size_t j = 0; j < num_kcas_; ++j) {
+                KcasDesc &d = kcas_desc_[(start + j) % num_kcas_];
+                uint32_t idle = 0;
+                if (d.busy.load(std::memory_order_relaxed) == 0 &&
+                    d.busy.compare_exchange_strong(idle, 1, std::memory_order_acquire, std::memory_order_relaxed))
+                    return static_cast<uint32_t>((start + j) % num_kcas_);
+            }
+            WAIT::pause(round);
+        }
+    }
+
+    // read the descriptor behind mark for cell idx; false if it has been reused since (then the
+    // marker is gone from the cell) or mark is not a live kcas marker
+    bool kcas_view(size_t idx, packed_t mark, KcasView &v) const noexcept {
+        v.id = static_cast<uint32_t>(mark & low_mask(12));
+        v.seq = (mark >> 12) & KCAS_SEQ_MASK;
+        if (v.id >= num_kcas_) return false;
+        const KcasDesc &d = kcas_desc_[v.id];
+        const uint64_t s1 = d.status.load(std::memory_order_acquire);
+        if (((s1 >> 2) & KCAS_SEQ_MASK) != v.seq || (s1 & 3) == KCAS_PREP) return false;
+        bool found = false;
+        const size_t k = std::min<size_t>(d.k.load(std::memory_order_relaxed), KCAS_MAX);
+        for (size_t j = 0; j < k && !found; ++j) {
+            if (d.idx[j].load(std::memory_order_relaxed) != idx) continue;
+            v.expected = d.expected[j].load(std::memory_order_relaxed);
+            v.desired = d.desired[j].load(std::memory_order_relaxed);
+            found = true;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t s2 = d.status.load(std::memory_order_relaxed);
+        if ((s2 >> 2) != (s1 >> 2)) return false;
+        v.state = s2 & 3;
+        return found;
+    }
+
+    // another op's marker sits on idx: finish the cell if that op is decided, otherwise wait
+    // out the grace period and abort it. false if the marker could not be resolved.
+    bool kcas_help(size_t idx, packed_t mark, unsigned round) noexcept {
+        KcasView v;
+        if (!kcas_view(idx, mark, v)) return false;
+        if (v.state == KCAS_UNDECIDED) {
+            if (round < KCAS_GRACE) { WAIT::pause(round); return true; }
+            uint64_t undecided = v.seq << 2 | KCAS_UNDECIDED;
+            kcas_desc_[v.id].status.compare_exchange_strong(undecided, v.seq << 2 | KCAS_FAILED,
+                                                            std::memory_order_acq_rel, std::memory_order_acquire);
+            if (!kcas_view(idx, mark, v)) return false;
+        }
+        packed_t cur = mark;
+        compare_exchange(idx, cur, v.state == KCAS_SUCCEEDED ? v.desired : v.expected);
+        return true;
+    }
+
+    std::unique_ptr<KcasDesc[]> kcas_desc_;
+    size_t num_kcas_{0};
 
     // memory node
     int node_{0};
+    AllocNW::AllocOptions alloc_{};
+    size_t align_{64};
+
+    // region epochs: per-region bump word (epoch << 8 | ST_IDLE or ST_EPOCH_BUMP) and one
+    // announcement slot per registered thread (region + 1, 0 when quiescent)
+    struct alignas(64) EpochSlot {
+        std::atomic<uint64_t> region{0};
+        std::atomic<bool> used{false};
+    };
+    static inline bool is_bumping(uint64_t w) noexcept { return (w & 0xFF) == ST_EPOCH_BUMP; }
+    static inline packed_t bumped_clock(packed_t p, EpochBump kind, uint64_t delta) noexcept {
+        const tag8_t st = PackedCell::st_from_strel(PackedCell::extract_strel(p));
+        const tag8_t rel = PackedCell::rel_from_strel(PackedCell::extract_strel(p));
+        if constexpr (MODE == PackedMode::MODE_VALUE32) {
+            const uint64_t c = kind == EpochBump::REBASE ? 0 : PackedCell::extract_clk16(p) + delta;
+            return PackedCell::compose_value32(PackedCell::extract_value32(p), static_cast<clk16_t>(c), st, rel);
+        } else {
+            const uint64_t c = kind == EpochBump::REBASE ? 0 : PackedCell::extract_clk48(p) + delta;
+            return PackedCell::compose_clk48(static_cast<clk48_t>(c), st, rel);
+        }
+    }
+
+    size_t epoch_cells_{0};
+    size_t num_epoch_regions_{0};
+    std::unique_ptr<std::atomic<uint64_t>[]> region_bump_;
+    std::unique_ptr<EpochSlot[]> epoch_slot_;
+    size_t num_epoch_slots_{0};
+
+    // file mapping (init_from_file)
+    void* map_base_{nullptr};
+    size_t map_bytes_{0};
+    int map_fd_{-1};
+
+    [[no_unique_address]] HotPathStats<STATS::enabled> stats_;
+};
+
+} // namespace AtomicCScompact
+#pragma once
+// RluArray.hpp
+// Read-Log-Update over AtomicPCArray (Matveev et al., SOSP'15; DOCS/papers/Read-Log-Update.pdf).
+// A writer locks a cell by swapping in an ST_RLU_LOCKED marker that names a copy in its write
+// log, edits the copies and commits them by advancing a global clock. A reader stamps the clock
+// when its section starts and resolves every marker it meets to the copy (committed no later
+// than its stamp) or the original, so readers never wait or retry on writers. A committing
+// writer waits for readers older than its commit clock, then writes the copies back.
+// Readers touch only their own context line and the clock, which moves once per commit.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+
+namespace AtomicCScompact {
+
+// Cells handled by an RluArray must change only through it while it is in use. One section per
+// thread at a time: reader_lock() .. reads/writes .. reader_unlock() (commit) or abort().
+template<PackedMode MODE, class WAIT = ParkWait, class STATS = NoStats>
+class RluArray {
+public:
+    using packed_t = packed64_t;
+    using Array = AtomicPCArray<MODE, WAIT, STATS>;
+
+    static inline constexpr size_t LOG_MAX = 64;       // cells one write section may lock
+    static inline constexpr size_t MAX_THREADS = 4096; // marker thread field is 12 bits
+
+    explicit RluArray(Array &arr, size_t max_threads = 64) : arr_(arr) {
+        if (max_threads == 0 || max_threads > MAX_THREADS) throw std::invalid_argument("max_threads must be 1..4096");
+        ctx_.reset(new Ctx[max_threads]);
+        num_threads_ = max_threads;
+    }
+
+    RluArray(const RluArray&) = delete;
+    RluArray& operator=(const RluArray&) = delete;
+
+    // register_thread: claim a context slot for the calling thread; the id is passed to every
+    // other call. Throws when all max_threads slots are taken.
+    uint32_t register_thread() {
+        for (size_t i = 0; i < num_threads_; ++i) {
+            bool expected = false;
+            if (ctx_[i].used.compare_exchange_strong(expected, true, std::memory_order_acquire, std::memory_order_relaxed))
+                return static_cast<uint32_t>(i);
+        }
+        throw std::runtime_error("RluArray: all thread slots in use");
+    }
+    // outside a section only
+    void unregister_thread(uint32_t t) noexcept { ctx_[t].used.store(false, std::memory_order_release); }
+
+    // global clock: number of committed write sections. clk48 stamps carry its low 48 bits.
+    uint64_t clock() const noexcept { return clock_.load(std::memory_order_acquire); }
+
+    void reader_lock(uint32_t t) noexcept {
+        Ctx &c = ctx_[t];
+        c.run.fetch_add(1, std::memory_order_seq_cst); // odd: inside a section
+        const uint64_t now = clock_.load(std::memory_order_seq_cst);
+        c.local_clock.store(now, std::memory_order_relaxed);
+        c.stamp = now;
+    }
+
+    // read: the cell as of this section's clock stamp (plus this thread's own pending writes)
+    packed_t read(uint32_t t, size_t idx) const noexcept {
+        const packed_t v = arr_.load(idx, std::memory_order_acquire);
+        if (!is_rlu_marker(v)) return v;
+        const uint32_t owner = marker_thread(v);
+        const Log &log = ctx_[owner].logs[marker_log(v)];
+        const LogEntry &e = log.entries[marker_entry(v)];
+        if (owner == t || log.write_clock.load(std::memory_order_acquire) <= ctx_[t].stamp)
+            return e.copy.load(std::memory_order_acquire);
+        return e.orig.load(std::memory_order_relaxed);
+    }
+
+    // try_lock: log a copy of idx for this write section. false if another writer holds the cell
+    // (or a kcas op is in flight on it) or the log is full: abort() and retry the section.
+    bool try_lock(uint32_t t, size_t idx) noexcept {
+        return lock_entry(t, idx) != nullptr;
+    }
+
+    // write: lock idx if needed and set its copy; word must not be a ST_LOCKED/ST_RLU_LOCKED marker
+    bool write(uint32_t t, size_t idx, packed_t word) noexcept {
+        const tag8_t st = state_of(word);
+        if (st == ST_LOCKED || st == ST_RLU_LOCKED) return false;
+        LogEntry* e = lock_entry(t, idx);
+        if (!e) return false;
+        e->copy.store(word, std::memory_order_relaxed);
+        e->stamp = false;
+        return true;
+    }
+
+    // write_stamped (MODE_CLK48): the copy becomes (commit clock, st, rel) at commit, so the cell
+    // records the clock of the section that last wrote it
+    bool write_stamped(uint32_t t, size_t idx, tag8_t st, tag8_t rel) noexcept {
+        static_assert(MODE == PackedMode::MODE_CLK48, "write_stamped needs MODE_CLK48 cells");
+        if (st == ST_LOCKED || st == ST_RLU_LOCKED) return false;
+        LogEntry* e = lock_entry(t, idx);
+        if (!e) return false;
+        e->copy.store(PackedCell::compose_clk48(0, st, rel), std::memory_order_relaxed);
+        e->stamp = true;
+        return true;
+    }
+
+    // reader_unlock: leave the section; a section that wrote commits here (waits for older
+    // readers, then writes back). Returns the commit clock, 0 for a read-only section.
+    uint64_t reader_unlock(uint32_t t) noexcept {
+        Ctx &c = ctx_[t];
+        c.run.fetch_add(1, std::memory_order_release);
+        Log &log = c.logs[c.cur];
+        if (log.count == 0) return 0;
+
+        // commit clocks are handed out in order and the clock only ever moves to the next one,
+        // so no reader can hold our clock before our copies and write_clock are visible
+        const uint64_t wc = ticket_.fetch_add(1, std::memory_order_relaxed) + 1;
+        for (size_t i = 0; i < log.count; ++i) {
+            LogEntry &e = log.entries[i];
+            if (!e.stamp) continue;
+            const packed_t p = e.copy.load(std::memory_order_relaxed);
+            e.copy.store(PackedCell::compose_clk48(wc & low_mask(48), state_of(p), rel_of(p)),
+                         std::memory_order_relaxed);
+        }
+        log.write_clock.store(wc, std::memory_order_release);
+        for (unsigned round = 0; clock_.load(std::memory_order_acquire) != wc - 1; ++round) WAIT::pause(round);
+        clock_.store(wc, std::memory_order_seq_cst);
+
+        synchronize(wc);
+        for (size_t i = 0; i < log.count; ++i) {
+            const LogEntry &e = log.entries[i];
+            packed_t cur = marker(t, c.cur, i, e.orig.load(std::memory_order_relaxed));
+            arr_.compare_exchange(e.idx.load(std::memory_order_relaxed), cur, e.copy.load(std::memory_order_relaxed));
+        }
+        // the wait above covered every reader of the other log: it is free to reuse
+        c.logs[c.cur ^ 1].dirty = false;
+        retire_log(c);
+        return wc;
+    }
+
+    // abort: put back the originals of every locked cell and leave the section
+    void abort(uint32_t t) noexcept {
+        Ctx &c = ctx_[t];
+        c.run.fetch_add(1, std::memory_order_release);
+        Log &log = c.logs[c.cur];
+        for (size_t i = 0; i < log.count; ++i) {
+            const LogEntry &e = log.entries[i];
+            const packed_t orig = e.orig.load(std::memory_order_relaxed);
+            packed_t cur = marker(t, c.cur, i, orig);
+            arr_.compare_exchange(e.idx.load(std::memory_order_relaxed), cur, orig);
+        }
+        if (log.count != 0) retire_log(c);
+    }
+
+private:
+    // marker low 48 bits: thread (12) | log (1) | entry (8); st = ST_RLU_LOCKED, rel kept
+    static inline constexpr uint64_t CLOCK_INF = UINT64_MAX;
+
+    struct LogEntry {
+        std::atomic<size_t> idx{0};
+        std::atomic<packed_t> orig{0};
+        std::atomic<packed_t> copy{0};
+        bool stamp{false}; // owner only
+    };
+    struct Log {
+        std::atomic<uint64_t> write_clock{CLOCK_INF}; // commit clock of the section using this log
+        size_t count{0};  // owner only
+        bool dirty{false}; // owner only: readers may still resolve markers into this log
+        LogEntry entries[LOG_MAX];
+    };
+    struct alignas(64) Ctx {
+        std::atomic<uint64_t> run{0};         // odd while inside a section
+        std::atomic<uint64_t> local_clock{0}; // clock stamp of the current section
+        std::atomic<bool> used{false};
+        uint64_t stamp{0};                    // owner's copy of local_clock
+        unsigned cur{0};                      // log of the current write section
+        Log logs[2];
+    };
+
+    static inline tag8_t state_of(packed_t p) noexcept {
+        return PackedCell::st_from_strel(PackedCell::extract_strel(p));
+    }
+    static inline tag8_t rel_of(packed_t p) noexcept {
+        return PackedCell::rel_from_strel(PackedCell::extract_strel(p));
+    }
+    static inline bool is_rlu_marker(packed_t p) noexcept { return state_of(p) == ST_RLU_LOCKED; }
+    static inline uint32_t marker_thread(packed_t p) noexcept { return static_cast<uint32_t>(p & 0xFFF); }
+    static inline unsigned marker_log(packed_t p) noexcept { return static_cast<unsigned>((p >> 12) & 1); }
+    static inline size_t marker_entry(packed_t p) noexcept { return static_cast<size_t>((p >> 13) & 0xFF); }
+    static inline packed_t marker(uint32_t t, unsigned log, size_t entry, packed_t orig) noexcept {
+        const packed_t low = static_cast<packed_t>(t) | static_cast<packed_t>(log) << 12 | static_cast<packed_t>(entry) << 13;
+        return PackedCell::set_strel(low, make_strel(ST_RLU_LOCKED, rel_of(orig)));
+    }
+
+    LogEntry* lock_entry(uint32_t t, size_t idx) noexcept {
+        Ctx &c = ctx_[t];
+        Log &log = c.logs[c.cur];
+        if (idx >= arr_.size()) return nullptr;
+        packed_t cur = arr_.load(idx, std::memory_order_acquire);
+        while (true) {
+            if (is_rlu_marker(cur)) {
+                if (marker_thread(cur) != t) return nullptr;
+                return &log.entries[marker_entry(cur)];
+            }
+            if (state_of(cur) == ST_LOCKED || log.count == LOG_MAX) return nullptr;
+            if (log.count == 0) log.write_clock.store(CLOCK_INF, std::memory_order_relaxed);
+            LogEntry &e = log.entries[log.count];
+            e.idx.store(idx, std::memory_order_relaxed);
+            e.orig.store(cur, std::memory_order_relaxed);
+            e.copy.store(cur, std::memory_order_relaxed);
+            e.stamp = false;
+            // release via the CAS: a reader that sees the marker sees the entry
+            if (arr_.compare_exchange(idx, cur, marker(t, c.cur, log.count, cur))) return &log.entries[log.count++];
+        }
+    }
+
+    // switch to the other log; if readers may still use it (the last sections aborted without
+    // a grace period), wait them out first
+    void retire_log(Ctx &c) noexcept {
+        c.logs[c.cur].count = 0;
+        c.logs[c.cur].dirty = true;
+        c.cur ^= 1;
+        if (c.logs[c.cur].dirty) {
+            synchronize(CLOCK_INF);
+            c.logs[c.cur].dirty = false;
+        }
+    }
+
+    // wait until no reader whose stamp is older than wc is still in the section it stamped
+    void synchronize(uint64_t wc) const noexcept {
+        for (size_t i = 0; i < num_threads_; ++i) {
+            const Ctx &o = ctx_[i];
+            if (!o.used.load(std::memory_order_relaxed)) continue;
+            const uint64_t r = o.run.load(std::memory_order_seq_cst);
+            if ((r & 1) == 0 || o.local_clock.load(std::memory_order_acquire) >= wc) continue;
+            for (unsigned round = 0; o.run.load(std::memory_order_acquire) == r; ++round) WAIT::pause(round);
+        }
+    }
+
+    Array &arr_;
+    std::unique_ptr<Ctx[]> ctx_;
+    size_t num_threads_{0};
+    alignas(64) std::atomic<uint64_t> clock_{0};
+    alignas(64) std::atomic<uint64_t> ticket_{0};
+};
+
+} // namespace AtomicCScompact
+#pragma once
+// APCCpuWorker.hpp
+// Descriptor-driven committer engine over AtomicPCArray.
+// Writers push ACADescriptors into a lock-free MPMC ring; committer threads drain them in
+// batches, sort/coalesce by idx/count and apply one CAS per touched cell (BATCHED mode).
+// DIRECT mode applies every descriptor inline with a reserve_for_update/commit_update pair.
+// Idle committers, full-ring submitters and flush() wait per the WAIT policy.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+
+
+namespace AtomicCScompact {
+
+enum OPKind : uint8_t
+{
+    OP_SET        = 1, // value32 (or clk48) := arg
+    OP_APPLY_GRAD = 4, // value32 (or clk48) += arg (wrapping)
+    OP_EPOCH_BUMP = 5  // clk16 (or clk48) += max(arg, 1), value/st untouched
+};
+
+struct ACADescriptor
+{
+    uint8_t  op;
+    uint8_t  flags;
+    uint8_t  rel;   // 0 keeps the cell's rel
+    uint8_t  pad;
+    uint32_t idx;
+    uint32_t count; // cells [idx, idx + count)
+    uint64_t arg;
+};
+
+enum class CommitMode : int { DIRECT = 0, BATCHED = 1 };
+
+// Bounded MPMC ring of descriptors (per-cell sequence numbers, Vyukov style).
+// A popped slot stays owned by the consumer until release(pos), so the ring also records
+// which positions have been fully handled.
+class DescriptorRing {
+public:
+    explicit DescriptorRing(size_t capacity_pow2) {
+        if (capacity_pow2 < 2 || (capacity_pow2 & (capacity_pow2 - 1)) != 0)
+            throw std::invalid_argument("ring capacity must be a power of two >= 2");
+        mask_ = capacity_pow2 - 1;
+        cells_.reset(new Cell[capacity_pow2]);
+        for (size_t i = 0; i < capacity_pow2; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    DescriptorRing(const DescriptorRing&) = delete;
+    DescriptorRing& operator=(const DescriptorRing&) = delete;
+
+    size_t capacity() const noexcept { return mask_ + 1; }
+    size_t pushed() const noexcept { return tail_.load(std::memory_order_acquire); }
+    // no position claimed and not yet popped; the seq_cst tail load pairs with try_push's CAS
+    bool drained() const noexcept {
+        return tail_.load(std::memory_order_seq_cst) == head_.load(std::memory_order_acquire);
+    }
+
+    bool try_push(const ACADescriptor &d) noexcept {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        Cell* c;
+        while (true) {
+            c = &cells_[pos & mask_];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                // seq_cst (a plain locked CAS on x86) so submitters can skip the notify fence
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        c->d = d;
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(ACADescriptor &out, size_t &out_pos) noexcept {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        Cell* c;
+        while (true) {
+            c = &cells_[pos & mask_];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+        out = c->d;
+        out_pos = pos;
+        return true;
+    }
+
+    // hand a popped slot back to producers
+    void release(size_t pos) noexcept { cells_[pos & mask_].seq.store(pos + mask_ + 1, std::memory_order_release); }
+
+    // true once pos (< head) has been popped and released
+    bool released(size_t pos) const noexcept {
+        size_t seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+        return static_cast<intptr_t>(seq - (pos + mask_ + 1)) >= 0;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq{0};
+        ACADescriptor d{};
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_{0};
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+template<PackedMode MODE, class WAIT = ParkWait, class STATS = NoStats>
+class APCCpuWorker {
+public:
+    using packed_t = packed64_t;
+
+    // DIRECT on an array with region epochs (init_region_epochs first) takes up to
+    // direct_slots epoch slots here, one per submitting thread on first use; 0 = one per CPU.
+    APCCpuWorker(AtomicPCArray<MODE, WAIT, STATS> &arr, CommitMode mode = CommitMode::BATCHED,
+                 size_t ring_capacity = size_t(1) << 16, size_t batch_max = 4096, unsigned direct_slots = 0)
+      : arr_(arr), mode_(mode), ring_(ring_capacity), batch_max_(batch_max ? batch_max : 1)
+    {
+        if (mode_ != CommitMode::DIRECT || !arr_.region_epochs()) return;
+        if (direct_slots == 0) direct_slots = std::max(1u, std::thread::hardware_concurrency());
+        direct_slots_.reserve(direct_slots);
+        for (uint32_t t; direct_slots_.size() < direct_slots && (t = arr_.try_epoch_register()) != UINT32_MAX;)
+            direct_slots_.push_back(t);
+    }
+
+    ~APCCpuWorker() {
+        stop();
+        for (uint32_t t : direct_slots_) arr_.epoch_unregister(t);
+    }
+
+    APCCpuWorker(const APCCpuWorker&) = delete;
+    APCCpuWorker& operator=(const APCCpuWorker&) = delete;
+
+    CommitMode mode() const noexcept { return mode_; }
+
+    // start committer threads (BATCHED mode only; DIRECT applies inline).
+    // One committer applies descriptors in submission order; with several, descriptors that
+    // land in different batches may commit to the same cell in either order.
+    void start(unsigned committers = 1) {
+        if (mode_ != CommitMode::BATCHED || running_.load(std::memory_order_acquire)) return;
+        running_.store(true, std::memory_order_release);
+        for (unsigned t = 0; t < std::max(1u, committers); ++t)
+            threads_.emplace_back([this] { committer_loop(); });
+    }
+
+    // stop committers after draining everything submitted so far
+    void stop() noexcept {
+        if (!running_.exchange(false, std::memory_order_acq_rel)) return;
+        work_ec_.notify();
+        for (auto &t : threads_) if (t.joinable()) t.join();
+        threads_.clear();
+        while (drain_once(batch_max_) != 0) {}
+    }
+
+    bool try_submit(const ACADescriptor &d) noexcept {
+        if (mode_ == CommitMode::DIRECT) { apply_direct(d); return true; }
+        if (!ring_.try_push(d)) return false;
+        // only a committer that found the ring drained after prepare() sleeps, so the push
+        // CAS already orders against it: wake only when one is waiting, without a fence
+        if constexpr (WAIT::parks) work_ec_.notify_after_rmw();
+        return true;
+    }
+
+    // submit; waits per WAIT while the ring is full (drains inline when no committer runs)
+    void submit(const ACADescriptor &d) noexcept {
+        WaitOps::retry<WAIT>([&]() noexcept {
+            if (try_submit(d)) return true;
+            if (!running_.load(std::memory_order_acquire)) drain_once(batch_max_);
+            return false;
+        }, -1, &space_ec_);
+    }
+
+    // wait until every descriptor submitted before the call has been applied
+    void flush() noexcept {
+        if (mode_ == CommitMode::DIRECT) return;
+        // retired_ is a contiguous watermark over ring positions, so with several committers
+        // it only passes target once every earlier descriptor has been applied
+        size_t target = ring_.pushed();
+        WaitOps::retry<WAIT>([&]() noexcept {
+            if (retired_.load(std::memory_order_acquire) >= target) return true;
+            if (!running_.load(std::memory_order_acquire)) drain_once(batch_max_);
+            return retired_.load(std::memory_order_acquire) >= target;
+        }, -1, &space_ec_);
+    }
+
+    // one committer step: pop up to max descriptors, coalesce and apply. Returns descriptors retired.
+    size_t drain_once(size_t max) noexcept {
+        BatchState st;
+        return drain(st, max);
+    }
+
+    uint64_t cells_committed() const noexcept { return cells_committed_.load(std::memory_order_relaxed); }
+
+private:
+    // per-cell composed effect of several descriptors (associative, applied in submission order)
+    struct CellXform {
+        uint64_t set_val{0};
+        uint64_t add{0};
+        uint64_t clk_bump{0};
+        tag8_t   rel{0};
+        uint8_t  flags{0};
+    };
+    static constexpr uint8_t XF_SET   = 0x1;
+    static constexpr uint8_t XF_WRITE = 0x2;
+    static constexpr uint8_t XF_REL   = 0x4;
+
+    struct Pending {
+        ACADescriptor d;
+        uint32_t seq;
+    };
+
+    // committer-private buffers, reused across batches
+    struct BatchState {
+        std::vector<Pending> batch;
+        std::vector<CellXform> scratch;
+        std::vector<size_t> taken; // ring positions popped in this batch
+    };
+
+    static inline void compose(CellXform &x, const ACADescriptor &d) noexcept {
+        switch (d.op) {
+        case OP_SET:        x.set_val = d.arg; x.add = 0; x.flags |= XF_SET | XF_WRITE; break;
+        case OP_APPLY_GRAD: x.add += d.arg; x.flags |= XF_WRITE; break;
+        case OP_EPOCH_BUMP: x.clk_bump += d.arg ? d.arg : 1; return;
+        default: return;
+        }
+        if (d.rel) { x.rel = d.rel; x.flags |= XF_REL; }
+    }
+
+    static inline packed_t apply_xform(packed_t observed, const CellXform &x) noexcept {
+        strel_t sr = PackedCell::extract_strel(observed);
+        tag8_t st  = (x.flags & XF_WRITE) ? ST_PUBLISHED : PackedCell::st_from_strel(sr);
+        tag8_t rel = (x.flags & XF_REL) ? x.rel : PackedCell::rel_from_strel(sr);
+        if constexpr (MODE == PackedMode::MODE_VALUE32) {
+            val32_t v = (x.flags & XF_SET) ? static_cast<val32_t>(x.set_val) : PackedCell::extract_value32(observed);
+            v = static_cast<val32_t>(v + static_cast<val32_t>(x.add));
+            uint64_t clk = PackedCell::extract_clk16(observed) + ((x.flags & XF_WRITE) ? 1u : 0u) + x.clk_bump;
+            return PackedCell::compose_value32(v, static_cast<clk16_t>(clk), st, rel);
+        } else {
+            clk48_t c = (x.flags & XF_SET) ? static_cast<clk48_t>(x.set_val) : PackedCell::extract_clk48(observed);
+            c += x.add + x.clk_bump;
+            return PackedCell::compose_clk48(c, st, rel);
+        }
+    }
+
+    static inline bool is_pending(packed_t p) noexcept {
+        return PackedCell::st_from_strel(PackedCell::extract_strel(p)) == ST_PENDING;
+    }
+
+    // BATCHED: single CAS from the observed value (commit_update also notifies waiters)
+    void commit_cell(size_t idx, const CellXform &x) noexcept {
+        for (unsigned round = 0;; ++round) {
+            packed_t observed = arr_.load(idx);
+            if (is_pending(observed)) { WAIT::pause(round); continue; }
+            if (arr_.commit_update(idx, observed, apply_xform(observed, x))) return;
+        }
+    }
+
+    // epoch slot of the calling thread: handed out once per (thread, worker) from direct_slots_
+    // and cached thread-locally. NO_SLOT once the pool is used up (slots of exited threads are
+    // not recycled).
+    uint32_t direct_slot() noexcept {
+        struct Entry { uint64_t worker; uint32_t slot; };
+        thread_local Entry cache[4] = {};
+        thread_local unsigned victim = 0;
+        for (const Entry &e : cache) if (e.worker == id_) return e.slot;
+        size_t k = next_direct_.fetch_add(1, std::memory_order_relaxed);
+        uint32_t slot = k < direct_slots_.size() ? direct_slots_[k] : NO_SLOT;
+        cache[victim++ % 4] = Entry{id_, slot};
+        return slot;
+    }
+
+    // DIRECT: the classic reserve_for_update / commit_update pair per cell. With region epochs
+    // on, each pair is announced in the thread's own slot so epoch_bump never sees a
+    // half-applied cell. A thread without a slot takes the committers' path instead: one CAS
+    // per cell (commit_cell), which a bump needs no announcement for.
+    void apply_direct(const ACADescriptor &d) noexcept {
+        CellXform x;
+        compose(x, d);
+        size_t end = std::min(arr_.size(), size_t(d.idx) + d.count);
+        const uint32_t slot = arr_.region_epochs() ? direct_slot() : NO_SLOT;
+        if (arr_.region_epochs() && slot == NO_SLOT) {
+            for (size_t i = d.idx; i < end; ++i) commit_cell(i, x);
+            cells_committed_.fetch_add(end > d.idx ? end - d.idx : 0, std::memory_order_relaxed);
+            return;
+        }
+        uint16_t batch_low = static_cast<uint16_t>(batch_id_.fetch_add(1, std::memory_order_relaxed));
+        for (size_t i = d.idx; i < end; ++i) {
+            for (unsigned round = 0;; ++round) {
+                if (slot != NO_SLOT) arr_.epoch_enter(slot, i);
+                packed_t observed = arr_.load(i);
+                bool done = false;
+                if (!is_pending(observed)) {
+                    packed_t committed = apply_xform(observed, x);
+                    tag8_t rel = PackedCell::rel_from_strel(PackedCell::extract_strel(committed));
+                    if (arr_.reserve_for_update(i, observed, batch_low, rel)) {
+                        arr_.commit_update(i, arr_.make_pending(observed, batch_low, rel), committed);
+                        done = true;
+                    }
+                }
+                if (slot != NO_SLOT) arr_.epoch_exit(slot);
+                if (done) break;
+                if (is_pending(observed)) WAIT::pause(round);
+            }
+        }
+        cells_committed_.fetch_add(end > d.idx ? end - d.idx : 0, std::memory_order_relaxed);
+    }
+
+    size_t drain(BatchState &st, size_t max) noexcept {
+        auto &batch = st.batch;
+        batch.clear();
+        st.taken.clear();
+        size_t popped = 0;
+        ACADescriptor d;
+        size_t pos;
+        while (popped < max && ring_.try_pop(d, pos)) {
+            ++popped;
+            st.taken.push_back(pos);
+            // empty/out-of-range descriptors are retired without touching the array
+            if (d.count != 0 && d.idx < arr_.size()) batch.push_back(Pending{d, static_cast<uint32_t>(popped)});
+        }
+        if (popped == 0) return 0;
+
+        // sort by start index (ties keep submission order), then walk clusters of overlapping ranges
+        std::sort(batch.begin(), batch.end(), [](const Pending &a, const Pending &b) {
+            return a.d.idx != b.d.idx ? a.d.idx < b.d.idx : a.seq < b.seq;
+        });
+        size_t n = arr_.size();
+        size_t committed = 0;
+        size_t i = 0;
+        while (i < batch.size()) {
+            size_t lo = batch[i].d.idx;
+            size_t hi = std::min(n, lo + batch[i].d.count);
+            size_t j = i + 1;
+            while (j < batch.size() && batch[j].d.idx < hi) {
+                hi = std::max(hi, std::min(n, size_t(batch[j].d.idx) + batch[j].d.count));
+                ++j;
+            }
+            if (j == i + 1) {
+                // lone range: one transform for every cell
+                CellXform x;
+                compose(x, batch[i].d);
+                for (size_t c = lo; c < hi; ++c) commit_cell(c, x);
+            } else {
+                // overlapping ranges: fold descriptors per cell in submission order, then one CAS per cell
+                std::sort(batch.begin() + i, batch.begin() + j, [](const Pending &a, const Pending &b) { return a.seq < b.seq; });
+                auto &scratch = st.scratch;
+                scratch.assign(hi - lo, CellXform{});
+                for (size_t k = i; k < j; ++k) {
+                    size_t s = batch[k].d.idx;
+                    size_t e = std::min(hi, s + batch[k].d.count);
+                    for (size_t c = s; c < e; ++c) compose(scratch[c - lo], batch[k].d);
+                }
+                for (size_t c = lo; c < hi; ++c) commit_cell(c, scratch[c - lo]);
+            }
+            committed += hi - lo;
+            i = j;
+        }
+        cells_committed_.fetch_add(committed, std::memory_order_relaxed);
+        for (size_t p : st.taken) ring_.release(p);
+        advance_retired();
+        if constexpr (WAIT::parks) space_ec_.notify();
+        return popped;
+    }
+
+    // move retired_ over every released position. The fence orders our releases before the
+    // scan, so of two committers finishing neighbouring positions at least one sees both.
+    void advance_retired() noexcept {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        size_t w = retired_.load(std::memory_order_acquire);
+        while (ring_.released(w))
+            if (retired_.compare_exchange_weak(w, w + 1, std::memory_order_acq_rel, std::memory_order_acquire)) ++w;
+    }
+
+    void committer_loop() noexcept {
+        BatchState st;
+        st.batch.reserve(batch_max_);
+        unsigned idle = 0;
+        while (running_.load(std::memory_order_acquire)) {
+            if (drain(st, batch_max_) != 0) { idle = 0; continue; }
+            if constexpr (WAIT::parks) {
+                // eventcount: a submit or stop() after prepare() bumps the epoch and ends the wait
+                // a position claimed but not yet written keeps us awake: its submitter may have
+                // read waiters before our prepare()
+                uint32_t key = work_ec_.prepare();
+                if (drain(st, batch_max_) == 0 && ring_.drained() && running_.load(std::memory_order_acquire))
+                    work_ec_.wait(key, false, FutexWait::Deadline{});
+                work_ec_.cancel();
+            } else {
+                WAIT::pause(idle++);
+            }
+        }
+    }
+
+    AtomicPCArray<MODE, WAIT, STATS> &arr_;
+    CommitMode mode_;
+    DescriptorRing ring_;
+    size_t batch_max_;
+
+    std::vector<std::thread> threads_;
+    std::atomic<bool> running_{false};
+    alignas(64) std::atomic<size_t> retired_{0}; // every ring position below this is applied
+    EventCount work_ec_;  // rung by submit for parked committers
+    EventCount space_ec_; // rung after each drained batch for full-ring submitters and flush()
+    std::atomic<uint64_t> cells_committed_{0};
+    std::atomic<uint32_t> batch_id_{0};
+
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+    static inline std::atomic<uint64_t> next_id_{1};
+    const uint64_t id_ = next_id_.fetch_add(1, std::memory_order_relaxed); // direct_slot() cache key
+    std::vector<uint32_t> direct_slots_;
+    std::atomic<size_t> next_direct_{0};
 };
 
 } // namespace AtomicCScompact
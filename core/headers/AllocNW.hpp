@@ -1,7 +1,15 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cstddef>
 #include <cstdlib>
+#include <cstring>
+#include <mutex>
 #include <new>
+#include <thread>
+#include <vector>
 
 #if defined(_WIN32)
     #ifndef WIN32_LEAN_AND_MEAN
@@ -12,13 +20,37 @@
 #elif defined(HAVE_LIBNUMA)
     #include <numa.h>
     #include <numaif.h>
+    #include <sys/mman.h>
     #include <unistd.h>
+    #include <cstdint>
+    #include <stdexcept>
 #else
   #error "AllocNW.hpp requires either Windows NUMA (VirtualAllocExNuma) or Linux libnuma. Define HAVE_LIBNUMA and link -lnuma for Linux."
 #endif
 
 namespace AtomicCScompact::AllocNW
 {
+    // Placement of the pages
+    //   BIND       : only on node (fails/OOMs rather than spill)
+    //   PREFERRED  : node first, other nodes when it is full
+    //   INTERLEAVE : round-robin across all allowed nodes (node ignored)
+    enum class NumaPolicy { BIND, PREFERRED, INTERLEAVE };
+
+    // Page size
+    //   DEFAULT : base pages
+    //   THP     : base-page mapping advised MADV_HUGEPAGE (transparent huge pages)
+    //   HUGE_2M / HUGE_1G : hugetlbfs pages (need reserved huge pages, see hugetlb_fallback)
+    enum class PageKind { DEFAULT, THP, HUGE_2M, HUGE_1G };
+
+    struct AllocOptions {
+        int node = 0;
+        NumaPolicy policy = NumaPolicy::BIND;
+        PageKind pages = PageKind::DEFAULT;
+        bool hugetlb_fallback = true; // HUGE_*: fall back to THP when no huge pages are reserved
+        bool populate = false;        // fault every page in now, under the chosen policy
+        unsigned populate_threads = 0; // populate: 0 = one thread per CPU of node, 1 = caller only
+        bool arena = true;            // Alloc/Free: serve small plain requests from NodeArena
+    };
     inline void* AlignedAllocP(size_t alignment, size_t size)
     {
         if (alignment == 0) alignment = alignof(void*);
@@ -55,32 +87,153 @@ namespace AtomicCScompact::AllocNW
     #endif
     }
 
+    // mapping granularity for a page kind; sizes are rounded up to it on alloc and free
+    inline size_t PageBytes(PageKind k)
+    {
+        switch (k) {
+        case PageKind::HUGE_2M: return size_t(2) << 20;
+        case PageKind::HUGE_1G: return size_t(1) << 30;
+        default:                return PageSize();
+        }
+    }
+
+    // FirstTouch: fault [p, p + bytes) in from `threads` workers (0 = one per CPU of node), each
+    // pinned to node (node < 0: unpinned) and taking a contiguous run of whole `page`s. Pages
+    // without a policy land on node, and the kernel zeroes them in parallel instead of on one
+    // core. write = false only reads, so file-backed pages are not dirtied.
+    inline void FirstTouch(void* p, size_t bytes, int node, unsigned threads = 0, bool write = true,
+                           size_t page = PageSize())
+    {
+        if (!p || bytes == 0) return;
+        if (page == 0) page = PageSize();
+        const size_t pages = (bytes + page - 1) / page;
+        if (threads == 0) {
+        #if defined(HAVE_LIBNUMA)
+            if (node >= 0 && numa_available() >= 0) {
+                bitmask* cpus = numa_allocate_cpumask();
+                if (numa_node_to_cpus(node, cpus) == 0) threads = numa_bitmask_weight(cpus);
+                numa_free_cpumask(cpus);
+            }
+        #endif
+            if (threads == 0) threads = std::thread::hardware_concurrency();
+        }
+        // a worker per 16 MiB at most; below that the spawn costs more than the faults
+        const size_t min_pages = ((size_t(16) << 20) + page - 1) / page;
+        size_t workers = std::min<size_t>(threads ? threads : 1, (pages + min_pages - 1) / min_pages);
+        if (workers == 0) workers = 1;
+        const size_t per = (pages + workers - 1) / workers;
+
+        auto touch = [=](size_t first, size_t last, bool pin) {
+        #if defined(HAVE_LIBNUMA)
+            if (pin && node >= 0) numa_run_on_node(node);
+        #else
+            (void)pin;
+        #endif
+            char* b = static_cast<char*>(p) + first * page;
+            const size_t len = std::min(bytes - first * page, (last - first) * page);
+        #if defined(MADV_POPULATE_WRITE) && defined(MADV_POPULATE_READ)
+            // Linux 5.14+ faults the run in one call; older kernels say EINVAL and we touch below
+            if (madvise(b, len, write ? MADV_POPULATE_WRITE : MADV_POPULATE_READ) == 0) return;
+        #endif
+            for (size_t off = 0; off < len; off += page) {
+                if (write) static_cast<volatile char*>(b)[off] = static_cast<volatile char*>(b)[off];
+                else (void)static_cast<volatile char*>(b)[off];
+            }
+        };
+
+        std::vector<std::thread> pool;
+        pool.reserve(workers - 1);
+        for (size_t w = 1; w < workers; ++w) {
+            size_t first = w * per, last = std::min(pages, first + per);
+            if (first >= last) break;
+            try { pool.emplace_back(touch, first, last, true); }
+            catch (...) { touch(first, last, false); }
+        }
+        touch(0, std::min(pages, per), false); // the caller keeps its own affinity
+        for (auto &t : pool) t.join();
+    }
+
     // AlignedAllocONnode(alignment, sizeBytes, node)
 #if defined(HAVE_LIBNUMA)
-    inline void* AlignedAllocONnode(size_t alignment, size_t sizeBytes, int node)
+    // AllocWithOptions: anonymous mapping of sizeBytes (rounded to PageBytes(opt.pages)), aligned
+    // to max(alignment, page), with opt.policy applied before any page is touched. The memory is
+    // zero-filled (fresh anonymous pages), which callers may rely on.
+    // Release with FreeWithOptions using the same sizeBytes and opt.pages.
+    inline void* AllocWithOptions(size_t sizeBytes, const AllocOptions &opt, size_t alignment = 64)
     {
-        size_t ps = PageSize();
-        size_t rounded = ((sizeBytes + ps - 1) / ps) * ps;
         if (numa_available() < 0) throw std::runtime_error("libnuma not available");
-        if (node < 0 || node > numa_max_node()) throw std::invalid_argument("Invalid node");
-        // allocate with rounding
-        void* p = numa_alloc_onnode(rounded, node);
-        if (!p) throw std::bad_alloc();
+        if (opt.policy != NumaPolicy::INTERLEAVE && (opt.node < 0 || opt.node > numa_max_node()))
+            throw std::invalid_argument("Invalid node");
+        const size_t gran = PageBytes(opt.pages);
+        const size_t rounded = ((sizeBytes + gran - 1) / gran) * gran;
+        const bool hugetlb = opt.pages == PageKind::HUGE_2M || opt.pages == PageKind::HUGE_1G;
+        bool thp = opt.pages == PageKind::THP;
+        // THP can only back 2M-aligned ranges; hugetlb mappings come huge-page aligned
+        size_t align = std::max(alignment, gran);
+        if (thp && rounded >= (size_t(2) << 20)) align = std::max(align, size_t(2) << 20);
+        size_t span = rounded + (align > gran || thp ? align : 0);
+
+        void* raw = MAP_FAILED;
+        if (hugetlb) {
+            // reserves its pages up front so a short pool fails here, not with SIGBUS on touch
+            int hflags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                         (opt.pages == PageKind::HUGE_1G ? (30 << MAP_HUGE_SHIFT) : (21 << MAP_HUGE_SHIFT));
+            raw = mmap(nullptr, span, PROT_READ | PROT_WRITE, hflags, -1, 0);
+            if (raw == MAP_FAILED && !opt.hugetlb_fallback) throw std::bad_alloc();
+            if (raw == MAP_FAILED) { thp = true; span = rounded + align; } // base pages: align by trimming
+        }
+        // commit-charged like any heap allocation: under strict overcommit a failure shows up
+        // here as bad_alloc rather than as SIGSEGV on first touch
+        if (raw == MAP_FAILED) raw = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) throw std::bad_alloc();
+
+        // trim to [p, p + rounded) with p aligned
+        uintptr_t b = reinterpret_cast<uintptr_t>(raw);
+        uintptr_t a = (b + align - 1) / align * align;
+        if (a > b) munmap(raw, a - b);
+        if (b + span > a + rounded) munmap(reinterpret_cast<void*>(a + rounded), b + span - (a + rounded));
+        void* p = reinterpret_cast<void*>(a);
+
+        if (thp) madvise(p, rounded, MADV_HUGEPAGE);
+        if (opt.policy == NumaPolicy::INTERLEAVE) {
+            numa_interleave_memory(p, rounded, numa_all_nodes_ptr);
+        } else {
+            bitmask* nodes = numa_allocate_nodemask();
+            numa_bitmask_setbit(nodes, static_cast<unsigned>(opt.node));
+            int mode = opt.policy == NumaPolicy::BIND ? MPOL_BIND : MPOL_PREFERRED;
+            long rc = mbind(p, rounded, mode, nodes->maskp, nodes->size + 1, 0);
+            numa_free_nodemask(nodes);
+            if (rc != 0) { munmap(p, rounded); throw std::runtime_error("mbind failed"); }
+        }
+        if (opt.populate)
+            FirstTouch(p, rounded, opt.policy == NumaPolicy::INTERLEAVE ? -1 : opt.node, opt.populate_threads, true,
+                       thp ? PageSize() : gran);
         return p;
     }
 
-    inline void FreeONNode(void* p, size_t sizeBytes) noexcept
+    inline void FreeWithOptions(void* p, size_t sizeBytes, PageKind pages) noexcept
     {
         if (!p) return;
-        size_t ps = PageSize();
-        size_t rounded = ((sizeBytes + ps - 1) / ps) * ps;
-        numa_free(p, rounded);
+        const size_t gran = PageBytes(pages);
+        munmap(p, ((sizeBytes + gran - 1) / gran) * gran);
+    }
+
+    inline void* AlignedAllocONnode(size_t alignment, size_t sizeBytes, int node)
+    {
+        AllocOptions opt;
+        opt.node = node;
+        return AllocWithOptions(sizeBytes, opt, alignment);
+    }
+
+    inline void FreeONNode(void* p, size_t sizeBytes) noexcept
+    {
+        FreeWithOptions(p, sizeBytes, PageKind::DEFAULT);
     }
 
 #elif defined(_WIN32)
     inline void* AlignedAllocONnode(size_t alignment, size_t sizeBytes, int node)
     {
-        (void *)alignment;
+        (void)alignment; // VirtualAllocExNuma returns allocation-granularity (64K) aligned memory
         size_t ps = PageSize();
         size_t rounded = ((sizeBytes + ps - 1) / ps) * ps;
         HANDLE HProc = GetCurrentProcess();
@@ -96,6 +249,231 @@ namespace AtomicCScompact::AllocNW
         if (!p) return;
         VirtualFree(p, 0, MEM_RELEASE);
     }
+
+    // Windows: node placement only (large pages need SeLockMemoryPrivilege); memory is zero-filled
+    inline void* AllocWithOptions(size_t sizeBytes, const AllocOptions &opt, size_t alignment = 64)
+    {
+        void* p = AlignedAllocONnode(alignment, sizeBytes, opt.node);
+        if (opt.populate) FirstTouch(p, sizeBytes, -1, opt.populate_threads);
+        return p;
+    }
+
+    inline void FreeWithOptions(void* p, size_t sizeBytes, PageKind /*pages*/) noexcept
+    {
+        FreeONNode(p, sizeBytes);
+    }
 #endif
 
+    // NodeArena: per-node pools of power-of-two blocks (64 B .. MAX_BLOCK) carved from
+    // REGION_BYTES regions, so small per-tenant arrays cost neither a syscall nor a whole page.
+    // Each thread keeps a short free list per node and class; the node pool (one mutex) is hit
+    // only on a cache miss or overflow. Blocks are 64-byte aligned and handed out zero-filled.
+    // Regions are node-bound (BIND) and live until process exit.
+    class NodeArena {
+    public:
+        static inline constexpr size_t MIN_BLOCK = 64;
+        static inline constexpr size_t MAX_BLOCK = size_t(256) << 10;
+        static inline constexpr size_t CLASSES = 13;        // 64 << 0 .. 64 << 12
+        static inline constexpr size_t REGION_BYTES = size_t(64) << 20;
+        static inline constexpr int MAX_NODES = 64;
+        static inline constexpr unsigned TCACHE_MAX = 32;   // blocks per thread, node and class
+        static_assert((MIN_BLOCK << (CLASSES - 1)) == MAX_BLOCK);
+
+        static NodeArena& instance()
+        {
+            static NodeArena* a = new NodeArena(); // never destroyed: thread caches flush into it at exit
+            return *a;
+        }
+
+        static bool fits(size_t bytes, int node) noexcept
+        {
+            return bytes != 0 && bytes <= MAX_BLOCK && node >= 0 && node < MAX_NODES;
+        }
+
+        void* alloc(size_t bytes, int node)
+        {
+            const size_t c = class_of(bytes);
+            FreeBlock* f = nullptr;
+            if (ThreadCache* tc = cache()) {
+                Bin &b = tc->bin(node, c);
+                if (!b.head) refill(b, node, c);
+                if ((f = b.head)) {
+                    b.head = f->next;
+                    --b.count;
+                }
+            } else {
+                f = take_shared(node, c);
+            }
+            if (!f) return carve(node, c); // fresh region memory is zero already
+            std::memset(static_cast<void*>(f), 0, MIN_BLOCK << c); // recycled
+            return f;
+        }
+
+        void free(void* p, size_t bytes, int node) noexcept
+        {
+            if (!p) return;
+            const size_t c = class_of(bytes);
+            auto* f = static_cast<FreeBlock*>(p);
+            Bin* b = nullptr;
+            if (ThreadCache* tc = cache()) {
+                try { b = &tc->bin(node, c); } catch (...) {} // growing the node table may fail
+            }
+            if (!b) { // thread cache gone (static destructors at exit) or unavailable
+                Pool &pl = *pools_[node].load(std::memory_order_acquire);
+                std::lock_guard<std::mutex> lk(pl.mu);
+                f->next = pl.free[c];
+                pl.free[c] = f;
+                return;
+            }
+            f->next = b->head;
+            b->head = f;
+            if (++b->count > TCACHE_MAX) spill(*b, node, c, TCACHE_MAX / 2);
+        }
+
+        // bytes reserved from the OS for node (regions, used or not)
+        size_t reserved_bytes(int node) const noexcept
+        {
+            if (node < 0 || node >= MAX_NODES) return 0;
+            Pool* pl = pools_[node].load(std::memory_order_acquire);
+            return pl ? pl->reserved.load(std::memory_order_relaxed) : 0;
+        }
+
+    private:
+        struct FreeBlock { FreeBlock* next; };
+        struct Bin { FreeBlock* head = nullptr; unsigned count = 0; };
+        struct Pool {
+            std::mutex mu;
+            FreeBlock* free[CLASSES] = {};
+            char* cur = nullptr;
+            char* end = nullptr;
+            std::atomic<size_t> reserved{0};
+        };
+
+        struct ThreadCache {
+            std::vector<std::array<Bin, CLASSES>> nodes;
+            bool* gone;
+            explicit ThreadCache(bool* g) noexcept : gone(g) {}
+            Bin& bin(int node, size_t c)
+            {
+                if (static_cast<size_t>(node) >= nodes.size()) nodes.resize(static_cast<size_t>(node) + 1);
+                return nodes[static_cast<size_t>(node)][c];
+            }
+            ~ThreadCache()
+            {
+                for (size_t n = 0; n < nodes.size(); ++n)
+                    for (size_t c = 0; c < CLASSES; ++c)
+                        if (nodes[n][c].count) instance().spill(nodes[n][c], static_cast<int>(n), c, nodes[n][c].count);
+                *gone = true;
+            }
+        };
+
+        NodeArena() = default;
+
+        static size_t class_of(size_t bytes) noexcept
+        {
+            const size_t w = std::bit_width(std::max(bytes, MIN_BLOCK) - 1);
+            return w - 6; // log2(MIN_BLOCK)
+        }
+
+        // nullptr once this thread's cache is destroyed: objects with static storage are freed
+        // after the main thread's thread_locals, and must go straight to the node pool. The flag
+        // is trivially destructible, so it stays readable after tc is gone.
+        static ThreadCache* cache() noexcept
+        {
+            thread_local bool gone = false;
+            if (gone) return nullptr;
+            thread_local ThreadCache tc(&gone);
+            return &tc;
+        }
+
+        // pop one shared block of class c, or nullptr
+        FreeBlock* take_shared(int node, size_t c)
+        {
+            Pool &pl = pool(node);
+            std::lock_guard<std::mutex> lk(pl.mu);
+            FreeBlock* f = pl.free[c];
+            if (f) pl.free[c] = f->next;
+            return f;
+        }
+
+        Pool& pool(int node)
+        {
+            Pool* pl = pools_[node].load(std::memory_order_acquire);
+            if (pl) return *pl;
+            Pool* fresh = new Pool();
+            if (pools_[node].compare_exchange_strong(pl, fresh, std::memory_order_acq_rel)) return *fresh;
+            delete fresh;
+            return *pl;
+        }
+
+        // move up to TCACHE_MAX / 4 shared blocks of class c into b
+        void refill(Bin &b, int node, size_t c)
+        {
+            Pool &pl = pool(node);
+            std::lock_guard<std::mutex> lk(pl.mu);
+            for (unsigned i = 0; i < TCACHE_MAX / 4 && pl.free[c]; ++i) {
+                FreeBlock* f = pl.free[c];
+                pl.free[c] = f->next;
+                f->next = b.head;
+                b.head = f;
+                ++b.count;
+            }
+        }
+
+        // return k blocks of b to the node pool
+        void spill(Bin &b, int node, size_t c, unsigned k) noexcept
+        {
+            Pool &pl = *pools_[node].load(std::memory_order_acquire); // exists: b's blocks came from it
+            std::lock_guard<std::mutex> lk(pl.mu);
+            for (; k && b.head; --k) {
+                FreeBlock* f = b.head;
+                b.head = f->next;
+                --b.count;
+                f->next = pl.free[c];
+                pl.free[c] = f;
+            }
+        }
+
+        void* carve(int node, size_t c)
+        {
+            const size_t sz = MIN_BLOCK << c;
+            Pool &pl = pool(node);
+            std::lock_guard<std::mutex> lk(pl.mu);
+            if (static_cast<size_t>(pl.end - pl.cur) < sz) {
+                // the old region's tail is abandoned; at most MAX_BLOCK per REGION_BYTES
+                AllocOptions opt;
+                opt.node = node;
+                pl.cur = static_cast<char*>(AllocWithOptions(REGION_BYTES, opt, 64));
+                pl.end = pl.cur + REGION_BYTES;
+                pl.reserved.fetch_add(REGION_BYTES, std::memory_order_relaxed);
+            }
+            void* p = pl.cur;
+            pl.cur += sz;
+            return p;
+        }
+
+        std::array<std::atomic<Pool*>, MAX_NODES> pools_{};
+    };
+
+    // Alloc/Free: AllocWithOptions/FreeWithOptions, except that small requests for base pages
+    // under a BIND policy without populate (the defaults) come from NodeArena. Memory is
+    // zero-filled either way. Free must get the same sizeBytes, opt and alignment.
+    inline bool ArenaServes(size_t sizeBytes, const AllocOptions &opt, size_t alignment) noexcept
+    {
+        return opt.arena && opt.pages == PageKind::DEFAULT && opt.policy == NumaPolicy::BIND && !opt.populate &&
+               alignment <= NodeArena::MIN_BLOCK && NodeArena::fits(sizeBytes, opt.node);
+    }
+
+    inline void* Alloc(size_t sizeBytes, const AllocOptions &opt, size_t alignment = 64)
+    {
+        if (ArenaServes(sizeBytes, opt, alignment)) return NodeArena::instance().alloc(sizeBytes, opt.node);
+        return AllocWithOptions(sizeBytes, opt, alignment);
+    }
+
+    inline void Free(void* p, size_t sizeBytes, const AllocOptions &opt, size_t alignment = 64) noexcept
+    {
+        if (ArenaServes(sizeBytes, opt, alignment)) NodeArena::instance().free(p, sizeBytes, opt.node);
+        else FreeWithOptions(p, sizeBytes, opt.pages);
+    }
+
 } // namespace AtomicCScompact::AllocNW
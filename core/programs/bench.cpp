@@ -0,0 +1,559 @@
+// bench.cpp
+// Throughput and latency of the hot paths:
+//   mailbox      : producers publish, consumers claim_one -> commit_index -> recycle
+//   mailbox_batch: producers publish_batch, consumers claim_batch -> commit_index -> recycle
+//   array        : AtomicPCArray reserve_for_update -> commit_update on random cells, then
+//                  single-threaded scan_rel_ranges passes over the result
+//   kcas         : k random cells incremented together, by AtomicPCArray::kcas and by a
+//                  64-way striped mutex (Mops/s counts committed updates)
+//   rlu          : 95% read sections (one cell) / 5% write sections (increment one cell) over
+//                  RluArray, against one std::shared_mutex
+//   dualrail     : DualRailArray stores on random cells, then verify_all sweeps (Mops/s counts
+//                  cells checked; x8 for bytes read). value32 rows only.
+//   worker       : APCCpuWorker OP_APPLY_GRAD descriptors on random cells, applied inline
+//                  (DIRECT) or by one committer thread (BATCHED; Mops/s includes the final flush)
+// Every 8th call is timed (claim calls include empty polls); one row per (bench, op) with
+// Mops/s and p50/p99/p999 in ns.
+//
+// usage: AtomicCIM_bench [threads=4] [capacity=65536] [ops=1000000] [rel=uniform|single|skew]
+//                        [mode=value32|clk48|both] [node=0] [index=0|1] [layout=linear|spread]
+//                        [bench=all|mailbox|array|kcas|rlu|dualrail|worker] [k=4]
+//                        [format=csv|json]
+
+#include "Full.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace AtomicCScompact;
+using Clock = std::chrono::steady_clock;
+
+struct Config {
+    unsigned threads = 4;
+    size_t capacity = size_t(1) << 16;
+    size_t ops = 1000000;
+    std::string rel = "uniform";
+    std::string mode = "both";
+    int node = 0;
+    bool index = false;
+    std::string layout = "linear";
+    std::string bench = "all";
+    unsigned k = 4;
+    std::string format = "csv";
+};
+
+struct Row {
+    std::string bench, op, mode;
+    size_t ops = 0;
+    double mops = 0.0;
+    uint64_t p50 = 0, p99 = 0, p999 = 0;
+};
+
+static constexpr unsigned SAMPLE_EVERY = 8;
+
+// per-thread latency samples, merged once the phase ends
+struct Samples {
+    std::vector<uint32_t> ns;
+    unsigned tick = 0;
+    bool every = false; // time every call instead of one in SAMPLE_EVERY
+
+    template<class F>
+    inline auto time(F &&f) {
+        if (!every && (++tick & (SAMPLE_EVERY - 1)) != 0) return f();
+        auto t0 = Clock::now();
+        auto r = f();
+        ns.push_back(static_cast<uint32_t>(std::min<int64_t>(UINT32_MAX,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count())));
+        return r;
+    }
+};
+
+static Row make_row(const char* bench, const char* op, const char* mode, size_t ops, double secs,
+                    std::vector<Samples> &per_thread)
+{
+    std::vector<uint32_t> all;
+    for (auto &s : per_thread) all.insert(all.end(), s.ns.begin(), s.ns.end());
+    std::sort(all.begin(), all.end());
+    auto pct = [&](double p) -> uint64_t {
+        return all.empty() ? 0 : all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))];
+    };
+    return Row{bench, op, mode, ops, secs > 0 ? ops / secs / 1e6 : 0.0, pct(0.50), pct(0.99), pct(0.999)};
+}
+
+// rel distribution: uniform over NODE0..SELF, a single bit, or 80% NODE0
+static tag8_t pick_rel(const std::string &dist, std::mt19937 &rng) {
+    static constexpr tag8_t bits[] = {REL_NODE0, REL_NODE1, REL_PAGE, REL_PATTERN, REL_SELF};
+    if (dist == "single") return REL_NODE0;
+    if (dist == "skew" && rng() % 10 < 8) return REL_NODE0;
+    return bits[rng() % 5];
+}
+
+template<PackedMode MODE>
+static packed64_t make_item(uint32_t v, tag8_t st, tag8_t rel) {
+    if constexpr (MODE == PackedMode::MODE_VALUE32) return PackedCell::compose_value32(v, 0, st, rel);
+    else return PackedCell::compose_clk48(v, st, rel);
+}
+
+static double seconds_since(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+template<PackedMode MODE>
+static void bench_mailbox(const Config &cfg, const char* mode, bool batched, std::vector<Row> &rows)
+{
+    using Mailbox = MPMCArrayPacked<MODE>;
+    MailboxOptions opt;
+    opt.node = cfg.node;
+    opt.published_index = cfg.index;
+    opt.layout = cfg.layout == "spread" ? MailboxLayout::SPREAD : MailboxLayout::LINEAR;
+    Mailbox mb(cfg.capacity, opt);
+    const unsigned producers = std::max(1u, cfg.threads / 2);
+    const unsigned consumers = std::max(1u, cfg.threads - producers);
+    const size_t per_producer = cfg.ops / producers;
+    const size_t total = per_producer * producers;
+    constexpr size_t BATCH = 64;
+
+    std::vector<Samples> pub_s(producers), claim_s(consumers), commit_s(consumers), recycle_s(consumers);
+    std::atomic<size_t> consumed{0};
+    std::vector<std::thread> th;
+    auto t0 = Clock::now();
+
+    for (unsigned p = 0; p < producers; ++p) th.emplace_back([&, p] {
+        std::mt19937 rng(p + 1);
+        std::vector<packed64_t> items(BATCH);
+        for (size_t i = 0; i < per_producer;) {
+            if (batched) {
+                size_t n = std::min(BATCH, per_producer - i);
+                for (size_t k = 0; k < n; ++k)
+                    items[k] = make_item<MODE>(static_cast<uint32_t>(i + k), ST_PUBLISHED, pick_rel(cfg.rel, rng));
+                size_t off = 0;
+                while (off < n) {
+                    off += pub_s[p].time([&] { return mb.publish_batch(std::span<const packed64_t>(items.data() + off, n - off)); });
+                    if (off < n) std::this_thread::yield();
+                }
+                i += n;
+            } else {
+                packed64_t it = make_item<MODE>(static_cast<uint32_t>(i), ST_PUBLISHED, pick_rel(cfg.rel, rng));
+                if (pub_s[p].time([&] { return mb.publish(it); }) != SIZE_MAX) ++i;
+                else std::this_thread::yield();
+            }
+        }
+    });
+
+    for (unsigned c = 0; c < consumers; ++c) th.emplace_back([&, c] {
+        std::vector<std::pair<size_t, packed64_t>> got;
+        got.reserve(BATCH);
+        while (consumed.load(std::memory_order_relaxed) < total) {
+            got.clear();
+            if (batched) {
+                claim_s[c].time([&] { return mb.claim_batch(REL_BROADCAST, got, BATCH); });
+            } else {
+                size_t idx;
+                packed64_t obs;
+                if (claim_s[c].time([&] { return mb.claim_one(REL_BROADCAST, idx, obs); })) got.emplace_back(idx, obs);
+            }
+            if (got.empty()) { std::this_thread::yield(); continue; }
+            for (auto &[idx, obs] : got) {
+                commit_s[c].time([&] { mb.commit_index(idx, obs); return 0; });
+                recycle_s[c].time([&] { return mb.recycle(idx); });
+            }
+            consumed.fetch_add(got.size(), std::memory_order_relaxed);
+        }
+    });
+
+    for (auto &t : th) t.join();
+    double secs = seconds_since(t0);
+    const char* name = batched ? "mailbox_batch" : "mailbox";
+    rows.push_back(make_row(name, batched ? "publish_batch" : "publish", mode, total, secs, pub_s));
+    rows.push_back(make_row(name, batched ? "claim_batch" : "claim_one", mode, total, secs, claim_s));
+    rows.push_back(make_row(name, "commit_index", mode, total, secs, commit_s));
+    rows.push_back(make_row(name, "recycle", mode, total, secs, recycle_s));
+}
+
+template<PackedMode MODE>
+static void bench_array(const Config &cfg, const char* mode, std::vector<Row> &rows)
+{
+    AtomicPCArray<MODE> arr;
+    arr.init_on_node(cfg.capacity, cfg.node);
+    if (cfg.index) arr.init_region_index(4096);
+    const unsigned threads = std::max(1u, cfg.threads);
+    const size_t per_thread = cfg.ops / threads;
+
+    std::vector<Samples> res_s(threads), com_s(threads);
+    std::vector<size_t> done(threads, 0);
+    std::vector<std::thread> th;
+    auto t0 = Clock::now();
+    for (unsigned t = 0; t < threads; ++t) th.emplace_back([&, t] {
+        std::mt19937 rng(t + 101);
+        for (size_t i = 0; i < per_thread; ++i) {
+            size_t idx = rng() % cfg.capacity;
+            tag8_t rel = pick_rel(cfg.rel, rng);
+            auto cur = arr.load(idx);
+            auto batch = static_cast<uint16_t>(i);
+            if (!res_s[t].time([&] { return arr.reserve_for_update(idx, cur, batch, rel); })) continue;
+            auto pending = arr.make_pending(cur, batch, rel);
+            auto committed = make_item<MODE>(static_cast<uint32_t>(i), ST_PUBLISHED, rel);
+            if (com_s[t].time([&] { return arr.commit_update(idx, pending, committed); })) ++done[t];
+        }
+    });
+    for (auto &t : th) t.join();
+    double secs = seconds_since(t0);
+    size_t committed = 0;
+    for (size_t d : done) committed += d;
+    rows.push_back(make_row("array", "reserve_for_update", mode, committed, secs, res_s));
+    rows.push_back(make_row("array", "commit_update", mode, committed, secs, com_s));
+
+    // scan: Mops/s counts cells examined
+    std::vector<Samples> scan_s(1);
+    scan_s[0].every = true;
+    const size_t passes = std::max<size_t>(8, (size_t(64) << 20) / cfg.capacity);
+    t0 = Clock::now();
+    for (size_t p = 0; p < passes; ++p) scan_s[0].time([&] { return arr.scan_rel_ranges(REL_NODE0).size(); });
+    secs = seconds_since(t0);
+    rows.push_back(make_row("array", "scan_rel_ranges", mode, passes * cfg.capacity, secs, scan_s));
+}
+
+// k distinct random cells
+static void pick_cells(size_t capacity, unsigned k, std::mt19937 &rng, size_t* out) {
+    for (unsigned j = 0; j < k; ++j) {
+        size_t c;
+        do { c = rng() % capacity; } while (std::find(out, out + j, c) != out + j);
+        out[j] = c;
+    }
+}
+
+template<PackedMode MODE>
+static void bench_kcas(const Config &cfg, const char* mode, std::vector<Row> &rows)
+{
+    const unsigned threads = std::max(1u, cfg.threads);
+    const size_t per_thread = cfg.ops / threads;
+    const unsigned k = std::min<unsigned>(cfg.k, AtomicPCArray<MODE>::KCAS_MAX);
+
+    {
+        AtomicPCArray<MODE> arr;
+        arr.init_on_node(cfg.capacity, cfg.node);
+        arr.init_kcas(std::max<size_t>(threads, 64));
+        std::vector<Samples> sm(threads);
+        std::vector<size_t> done(threads, 0);
+        std::vector<std::thread> th;
+        auto t0 = Clock::now();
+        for (unsigned t = 0; t < threads; ++t) th.emplace_back([&, t] {
+            std::mt19937 rng(t + 201);
+            size_t cells[AtomicPCArray<MODE>::KCAS_MAX];
+            KcasEntry e[AtomicPCArray<MODE>::KCAS_MAX];
+            for (size_t i = 0; i < per_thread; ++i) {
+                pick_cells(cfg.capacity, k, rng, cells);
+                bool ok = sm[t].time([&] {
+                    for (unsigned j = 0; j < k; ++j) {
+                        packed64_t cur = arr.load_resolved(cells[j]);
+                        e[j] = KcasEntry{cells[j], cur, make_item<MODE>(static_cast<uint32_t>(cur) + 1, ST_PUBLISHED, REL_NODE0)};
+                    }
+                    return arr.kcas(std::span<const KcasEntry>(e, k));
+                });
+                if (ok) ++done[t];
+            }
+        });
+        for (auto &t : th) t.join();
+        double secs = seconds_since(t0);
+        size_t committed = 0;
+        for (size_t d : done) committed += d;
+        rows.push_back(make_row("kcas", "kcas", mode, committed, secs, sm));
+    }
+    {
+        static constexpr size_t STRIPES = 64;
+        std::vector<std::atomic<packed64_t>> cells(cfg.capacity);
+        std::unique_ptr<std::mutex[]> locks(new std::mutex[STRIPES]);
+        std::vector<Samples> sm(threads);
+        std::vector<std::thread> th;
+        auto t0 = Clock::now();
+        for (unsigned t = 0; t < threads; ++t) th.emplace_back([&, t] {
+            std::mt19937 rng(t + 201);
+            size_t idx[AtomicPCArray<MODE>::KCAS_MAX], stripe[AtomicPCArray<MODE>::KCAS_MAX];
+            for (size_t i = 0; i < per_thread; ++i) {
+                pick_cells(cfg.capacity, k, rng, idx);
+                sm[t].time([&] {
+                    // distinct stripes in ascending order (insertion: k <= KCAS_MAX)
+                    unsigned n = 0;
+                    for (unsigned j = 0; j < k; ++j) {
+                        const size_t s = idx[j] % STRIPES;
+                        unsigned at = 0;
+                        while (at < n && stripe[at] < s) ++at;
+                        if (at < n && stripe[at] == s) continue;
+                        for (unsigned m = n; m > at; --m) stripe[m] = stripe[m - 1];
+                        stripe[at] = s;
+                        ++n;
+                    }
+                    for (unsigned j = 0; j < n; ++j) locks[stripe[j]].lock();
+                    for (unsigned j = 0; j < k; ++j) {
+                        packed64_t cur = cells[idx[j]].load(std::memory_order_relaxed);
+                        cells[idx[j]].store(make_item<MODE>(static_cast<uint32_t>(cur) + 1, ST_PUBLISHED, REL_NODE0),
+                                            std::memory_order_relaxed);
+                    }
+                    for (unsigned j = n; j-- > 0;) locks[stripe[j]].unlock();
+                    return 0;
+                });
+            }
+        });
+        for (auto &t : th) t.join();
+        double secs = seconds_since(t0);
+        rows.push_back(make_row("kcas", "striped_lock", mode, per_thread * threads, secs, sm));
+    }
+}
+
+template<PackedMode MODE>
+static void bench_rlu(const Config &cfg, const char* mode, std::vector<Row> &rows)
+{
+    const unsigned threads = std::max(1u, cfg.threads);
+    const size_t per_thread = cfg.ops / threads;
+    constexpr unsigned WRITE_PCT = 5;
+
+    {
+        AtomicPCArray<MODE> arr;
+        arr.init_on_node(cfg.capacity, cfg.node);
+        RluArray<MODE> rlu(arr, threads);
+        std::vector<Samples> rd_s(threads), wr_s(threads);
+        std::vector<size_t> reads(threads, 0);
+        std::vector<uint64_t> sink(threads, 0); // keeps the reads
+        std::vector<std::thread> th;
+        auto t0 = Clock::now();
+        for (unsigned t = 0; t < threads; ++t) th.emplace_back([&, t] {
+            const uint32_t id = rlu.register_thread();
+            std::mt19937 rng(t + 301);
+            for (size_t i = 0; i < per_thread; ++i) {
+                const size_t idx = rng() % cfg.capacity;
+                if (rng() % 100 >= WRITE_PCT) {
+                    sink[t] += rd_s[t].time([&] {
+                        rlu.reader_lock(id);
+                        packed64_t v = rlu.read(id, idx);
+                        rlu.reader_unlock(id);
+                        return v;
+                    });
+                    ++reads[t];
+                    continue;
+                }
+                wr_s[t].time([&] {
+                    while (true) {
+                        rlu.reader_lock(id);
+                        packed64_t cur = rlu.read(id, idx);
+                        if (rlu.write(id, idx, make_item<MODE>(static_cast<uint32_t>(cur) + 1, ST_PUBLISHED, REL_NODE0)))
+                            return rlu.reader_unlock(id);
+                        rlu.abort(id);
+                    }
+                });
+            }
+            rlu.unregister_thread(id);
+        });
+        for (auto &t : th) t.join();
+        double secs = seconds_since(t0);
+        size_t r = 0;
+        for (size_t d : reads) r += d;
+        rows.push_back(make_row("rlu", "read", mode, r, secs, rd_s));
+        rows.push_back(make_row("rlu", "write", mode, per_thread * threads - r, secs, wr_s));
+    }
+    {
+        std::vector<std::atomic<packed64_t>> cells(cfg.capacity);
+        std::shared_mutex lock;
+        std::vector<Samples> rd_s(threads), wr_s(threads);
+        std::vector<size_t> reads(threads, 0);
+        std::vector<uint64_t> sink(threads, 0); // keeps the reads
+        std::vector<std::thread> th;
+        auto t0 = Clock::now();
+        for (unsigned t = 0; t < threads; ++t) th.emplace_back([&, t] {
+            std::mt19937 rng(t + 301);
+            for (size_t i = 0; i < per_thread; ++i) {
+                const size_t idx = rng() % cfg.capacity;
+                if (rng() % 100 >= WRITE_PCT) {
+                    sink[t] += rd_s[t].time([&] {
+                        std::shared_lock g(lock);
+                        return cells[idx].load(std::memory_order_relaxed);
+                    });
+                    ++reads[t];
+                    continue;
+                }
+                wr_s[t].time([&] {
+                    std::unique_lock g(lock);
+                    packed64_t cur = cells[idx].load(std::memory_order_relaxed);
+                    cells[idx].store(make_item<MODE>(static_cast<uint32_t>(cur) + 1, ST_PUBLISHED, REL_NODE0),
+                                     std::memory_order_relaxed);
+                    return 0;
+                });
+            }
+        });
+        for (auto &t : th) t.join();
+        double secs = seconds_since(t0);
+        size_t r = 0;
+        for (size_t d : reads) r += d;
+        rows.push_back(make_row("rlu", "rwlock_read", mode, r, secs, rd_s));
+        rows.push_back(make_row("rlu", "rwlock_write", mode, per_thread * threads - r, secs, wr_s));
+    }
+}
+
+static void bench_dualrail(const Config &cfg, const char* mode, std::vector<Row> &rows)
+{
+    const unsigned threads = std::max(1u, cfg.threads);
+    const size_t per_thread = cfg.ops / threads;
+    DualRailArray<> arr(cfg.capacity, cfg.node);
+
+    std::vector<Samples> st_s(threads);
+    std::vector<std::thread> th;
+    auto t0 = Clock::now();
+    for (unsigned t = 0; t < threads; ++t) th.emplace_back([&, t] {
+        std::mt19937 rng(t + 401);
+        for (size_t i = 0; i < per_thread; ++i) {
+            const size_t idx = rng() % cfg.capacity;
+            st_s[t].time([&] { arr.store(idx, static_cast<val32_t>(i), ST_PUBLISHED, REL_NODE0); return 0; });
+        }
+    });
+    for (auto &t : th) t.join();
+    double secs = seconds_since(t0);
+    rows.push_back(make_row("dualrail", "store", mode, per_thread * threads, secs, st_s));
+
+    std::vector<Samples> sweep_s(1);
+    sweep_s[0].every = true;
+    const size_t passes = std::max<size_t>(4, (size_t(256) << 20) / cfg.capacity);
+    std::vector<size_t> corrupt;
+    t0 = Clock::now();
+    for (size_t p = 0; p < passes; ++p) sweep_s[0].time([&] { return arr.verify_all(corrupt, cfg.threads); });
+    secs = seconds_since(t0);
+    if (!corrupt.empty()) throw std::runtime_error("dualrail: verify_all reported corrupt cells");
+    rows.push_back(make_row("dualrail", "verify_all", mode, passes * cfg.capacity, secs, sweep_s));
+}
+
+template<PackedMode MODE>
+static void bench_worker(const Config &cfg, const char* mode, CommitMode commit, std::vector<Row> &rows)
+{
+    AtomicPCArray<MODE> arr;
+    arr.init_on_node(cfg.capacity, cfg.node);
+    const unsigned threads = std::max(1u, cfg.threads);
+    const size_t per_thread = cfg.ops / threads;
+    APCCpuWorker<MODE> worker(arr, commit);
+    worker.start();
+
+    std::vector<Samples> sub_s(threads);
+    std::vector<std::thread> th;
+    auto t0 = Clock::now();
+    for (unsigned t = 0; t < threads; ++t) th.emplace_back([&, t] {
+        std::mt19937 rng(t + 501);
+        for (size_t i = 0; i < per_thread; ++i) {
+            ACADescriptor d{};
+            d.op = OP_APPLY_GRAD;
+            d.idx = static_cast<uint32_t>(rng() % cfg.capacity);
+            d.count = 1;
+            d.arg = 1;
+            sub_s[t].time([&] { worker.submit(d); return 0; });
+        }
+    });
+    for (auto &t : th) t.join();
+    worker.flush();
+    double secs = seconds_since(t0);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < cfg.capacity; ++i) {
+        if constexpr (MODE == PackedMode::MODE_VALUE32) sum += PackedCell::extract_value32(arr.load(i));
+        else sum += PackedCell::extract_clk48(arr.load(i));
+    }
+    if (sum != per_thread * threads) throw std::runtime_error("worker: flush returned before every descriptor applied");
+    rows.push_back(make_row("worker", commit == CommitMode::DIRECT ? "direct_submit" : "batched_submit", mode,
+                            per_thread * threads, secs, sub_s));
+}
+
+template<PackedMode MODE>
+static void run_mode(const Config &cfg, const char* mode, std::vector<Row> &rows)
+{
+    if (cfg.bench == "all" || cfg.bench == "mailbox") {
+        bench_mailbox<MODE>(cfg, mode, false, rows);
+        bench_mailbox<MODE>(cfg, mode, true, rows);
+    }
+    if (cfg.bench == "all" || cfg.bench == "array") bench_array<MODE>(cfg, mode, rows);
+    if (cfg.bench == "all" || cfg.bench == "kcas") bench_kcas<MODE>(cfg, mode, rows);
+    if (cfg.bench == "all" || cfg.bench == "rlu") bench_rlu<MODE>(cfg, mode, rows);
+    if constexpr (MODE == PackedMode::MODE_VALUE32)
+        if (cfg.bench == "all" || cfg.bench == "dualrail") bench_dualrail(cfg, mode, rows);
+    if (cfg.bench == "all" || cfg.bench == "worker") {
+        bench_worker<MODE>(cfg, mode, CommitMode::DIRECT, rows);
+        bench_worker<MODE>(cfg, mode, CommitMode::BATCHED, rows);
+    }
+}
+
+static void print_rows(const Config &cfg, const std::vector<Row> &rows)
+{
+    if (cfg.format == "json") {
+        std::printf("[\n");
+        for (size_t i = 0; i < rows.size(); ++i) {
+            const Row &r = rows[i];
+            std::printf("  {\"bench\":\"%s\",\"op\":\"%s\",\"mode\":\"%s\",\"threads\":%u,\"capacity\":%zu,"
+                        "\"rel\":\"%s\",\"node\":%d,\"ops\":%zu,\"mops\":%.3f,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu}%s\n",
+                r.bench.c_str(), r.op.c_str(), r.mode.c_str(), cfg.threads, cfg.capacity, cfg.rel.c_str(), cfg.node,
+                r.ops, r.mops, (unsigned long long)r.p50, (unsigned long long)r.p99, (unsigned long long)r.p999,
+                i + 1 < rows.size() ? "," : "");
+        }
+        std::printf("]\n");
+        return;
+    }
+    std::printf("bench,op,mode,threads,capacity,rel,node,ops,mops,p50_ns,p99_ns,p999_ns\n");
+    for (const Row &r : rows)
+        std::printf("%s,%s,%s,%u,%zu,%s,%d,%zu,%.3f,%llu,%llu,%llu\n",
+            r.bench.c_str(), r.op.c_str(), r.mode.c_str(), cfg.threads, cfg.capacity, cfg.rel.c_str(), cfg.node,
+            r.ops, r.mops, (unsigned long long)r.p50, (unsigned long long)r.p99, (unsigned long long)r.p999);
+}
+
+static bool parse_args(int argc, char** argv, Config &cfg)
+{
+    for (int i = 1; i < argc; ++i) {
+        const char* eq = std::strchr(argv[i], '=');
+        if (!eq) return false;
+        std::string key(argv[i], static_cast<size_t>(eq - argv[i])), val(eq + 1);
+        if (key == "threads") cfg.threads = static_cast<unsigned>(std::strtoul(val.c_str(), nullptr, 10));
+        else if (key == "capacity") cfg.capacity = std::strtoull(val.c_str(), nullptr, 10);
+        else if (key == "ops") cfg.ops = std::strtoull(val.c_str(), nullptr, 10);
+        else if (key == "rel") cfg.rel = val;
+        else if (key == "mode") cfg.mode = val;
+        else if (key == "node") cfg.node = std::atoi(val.c_str());
+        else if (key == "index") cfg.index = val == "1";
+        else if (key == "layout") cfg.layout = val;
+        else if (key == "bench") cfg.bench = val;
+        else if (key == "k") cfg.k = static_cast<unsigned>(std::strtoul(val.c_str(), nullptr, 10));
+        else if (key == "format") cfg.format = val;
+        else return false;
+    }
+    return cfg.threads > 0 && cfg.capacity > 0 && cfg.ops > 0 &&
+           (cfg.rel == "uniform" || cfg.rel == "single" || cfg.rel == "skew") &&
+           (cfg.mode == "value32" || cfg.mode == "clk48" || cfg.mode == "both") &&
+           (cfg.layout == "linear" || cfg.layout == "spread") &&
+           (cfg.bench == "all" || cfg.bench == "mailbox" || cfg.bench == "array" || cfg.bench == "kcas" ||
+            cfg.bench == "rlu" || cfg.bench == "dualrail" || cfg.bench == "worker") &&
+           cfg.k >= 1 && cfg.k <= 8 && cfg.capacity >= cfg.k &&
+           (cfg.format == "csv" || cfg.format == "json");
+}
+
+int main(int argc, char** argv)
+{
+    Config cfg;
+    if (!parse_args(argc, argv, cfg)) {
+        std::fprintf(stderr, "usage: %s [threads=N] [capacity=N] [ops=N] [rel=uniform|single|skew] "
+                             "[mode=value32|clk48|both] [node=N] [index=0|1] [layout=linear|spread] [bench=all|mailbox|array|kcas|rlu|dualrail|worker] "
+                             "[k=1..8] [format=csv|json]\n", argv[0]);
+        return 1;
+    }
+    std::vector<Row> rows;
+    try {
+        if (cfg.mode != "clk48") run_mode<PackedMode::MODE_VALUE32>(cfg, "value32", rows);
+        if (cfg.mode != "value32") run_mode<PackedMode::MODE_CLK48>(cfg, "clk48", rows);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "bench failed: %s\n", e.what());
+        return 1;
+    }
+    print_rows(cfg, rows);
+    return 0;
+}
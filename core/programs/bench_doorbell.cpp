@@ -0,0 +1,83 @@
+// bench_doorbell.cpp
+// Wake-up latency of an idle consumer: MPMCArrayPacked::claim_one_wait (doorbell) vs a
+// claim_one + yield spin loop. The producer publishes one item after a random idle gap; the consumer
+// reports publish->claim latency percentiles and its own CPU time.
+//
+// usage: AtomicCIM_doorbell_bench [items=2000] [gap_us=200]
+
+#include "Full.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+#include <ctime>
+
+using namespace AtomicCScompact;
+using Clock = std::chrono::steady_clock;
+using Mailbox = MPMCArrayPacked<PackedMode::MODE_VALUE32>;
+
+static double thread_cpu_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void run(const char* name, bool doorbell, int items, int gap_us)
+{
+    Mailbox mb(4096, 0, nullptr, nullptr, true);
+    std::atomic<int64_t> sent_ns{0};
+    std::vector<double> lat_us;
+    lat_us.reserve(items);
+    double cpu_ms = 0.0;
+
+    std::thread consumer([&] {
+        double c0 = thread_cpu_ms();
+        size_t idx;
+        packed64_t obs;
+        for (int i = 0; i < items; ++i) {
+            if (doorbell) {
+                while (!mb.claim_one_wait(REL_NODE0, idx, obs, -1)) {}
+            } else {
+                while (!mb.claim_one(REL_NODE0, idx, obs)) std::this_thread::yield();
+            }
+            int64_t now = Clock::now().time_since_epoch().count();
+            lat_us.push_back((now - sent_ns.load(std::memory_order_acquire)) / 1e3);
+            mb.recycle(idx);
+        }
+        cpu_ms = thread_cpu_ms() - c0;
+    });
+
+    std::mt19937 rng(42);
+    auto t0 = Clock::now();
+    for (int i = 0; i < items; ++i) {
+        std::this_thread::sleep_for(std::chrono::microseconds(gap_us / 2 + static_cast<int>(rng() % static_cast<unsigned>(gap_us + 1))));
+        while (mb.occupancy_exact() != 0) std::this_thread::yield();
+        sent_ns.store(Clock::now().time_since_epoch().count(), std::memory_order_release);
+        mb.publish(PackedCell::compose_value32(static_cast<val32_t>(i), 0, ST_PUBLISHED, REL_NODE0));
+    }
+    consumer.join();
+    double wall_ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+
+    std::sort(lat_us.begin(), lat_us.end());
+    auto pct = [&](double p) { return lat_us[std::min(lat_us.size() - 1, static_cast<size_t>(p * lat_us.size()))]; };
+    std::printf("%-9s items=%d p50=%.1fus p99=%.1fus p999=%.1fus consumer_cpu=%.1f%%\n",
+        name, items, pct(0.50), pct(0.99), pct(0.999), 100.0 * cpu_ms / wall_ms);
+}
+
+int main(int argc, char** argv)
+{
+    int items  = argc > 1 ? std::atoi(argv[1]) : 2000;
+    int gap_us = argc > 2 ? std::atoi(argv[2]) : 200;
+    if (items <= 0 || gap_us < 0) {
+        std::fprintf(stderr, "usage: %s [items] [gap_us]\n", argv[0]);
+        return 1;
+    }
+    run("spin", false, items, gap_us);
+    run("doorbell", true, items, gap_us);
+    return 0;
+}
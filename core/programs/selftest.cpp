@@ -0,0 +1,291 @@
+// selftest.cpp
+// Regression checks for the multi-cell protocols, run with several threads:
+//   kcas      : threads increment overlapping cell groups with kcas; every group stays in step
+//               and the totals match the committed ops; a failed kcas changes nothing
+//   rlu       : writers move units between cells in two-cell sections while readers sum all cells
+//               in one section; every reader sum is the invariant total (grace periods hold)
+//   checkpoint: a file-backed array is written, checkpointed, closed and reopened with the same
+//               values; reopening with a different n is refused
+//   shm       : a named ShmMailbox is created, attached by a second object on another thread,
+//               and every published item is claimed there exactly once
+// Prints one line per check and exits nonzero if any fails.
+//
+// usage: AtomicCIM_selftest [threads=2] [ops=20000]
+
+#include "Full.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+using namespace AtomicCScompact;
+using Array = AtomicPCArray<PackedMode::MODE_VALUE32>;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::fprintf(stderr, "  FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+static packed64_t item(uint32_t v)
+{
+    return PackedCell::compose_value32(v, 0, ST_PUBLISHED, REL_NODE0);
+}
+
+static uint32_t value(packed64_t p)
+{
+    return PackedCell::extract_value32(p);
+}
+
+static void test_kcas(unsigned threads, size_t ops)
+{
+    static constexpr size_t N = 64;
+    static constexpr unsigned K = 4;
+    Array arr;
+    arr.init_on_node(N, 0);
+    arr.init_kcas(threads);
+    for (size_t i = 0; i < N; ++i) arr.store(i, item(0));
+
+    // a kcas whose expected word is stale must leave every cell alone
+    KcasEntry stale[2] = {{0, item(0), item(5)}, {1, item(7), item(5)}};
+    check(!arr.kcas(std::span<const KcasEntry>(stale, 2)), "kcas with a stale entry succeeded");
+    check(value(arr.load(0)) == 0 && value(arr.load(1)) == 0, "failed kcas changed a cell");
+
+    // cells [0, K) are always bumped together; the rest in random groups of K
+    std::vector<size_t> group_ops(threads, 0), random_ops(threads, 0);
+    std::vector<std::thread> th;
+    for (unsigned t = 0; t < threads; ++t) th.emplace_back([&, t] {
+        std::mt19937 rng(t + 11);
+        KcasEntry e[K];
+        for (size_t i = 0; i < ops; ++i) {
+            const bool group = i % 2 == 0;
+            for (unsigned j = 0; j < K; ++j) {
+                size_t idx = K + j;
+                if (group) idx = j;
+                else {
+                    // K distinct cells outside the group
+                    bool dup;
+                    do {
+                        idx = K + rng() % (N - K);
+                        dup = false;
+                        for (unsigned m = 0; m < j; ++m) dup |= e[m].idx == idx;
+                    } while (dup);
+                }
+                const packed64_t cur = arr.load_resolved(idx);
+                e[j] = KcasEntry{idx, cur, item(value(cur) + 1)};
+            }
+            if (arr.kcas(std::span<const KcasEntry>(e, K))) ++(group ? group_ops[t] : random_ops[t]);
+            if (i % 16 == 0) std::this_thread::yield(); // interleave on few cores
+        }
+    });
+    for (auto &t : th) t.join();
+
+    size_t g = 0, r = 0;
+    for (unsigned t = 0; t < threads; ++t) { g += group_ops[t]; r += random_ops[t]; }
+    bool in_step = true;
+    for (unsigned j = 0; j < K; ++j) in_step &= value(arr.load(j)) == g;
+    check(in_step, "kcas group cells out of step");
+    uint64_t sum = 0;
+    for (size_t i = K; i < N; ++i) sum += value(arr.load(i));
+    check(sum == r * K, "kcas random-group total does not match committed ops");
+    std::printf("kcas        group=%zu random=%zu\n", g, r);
+}
+
+static void test_rlu(unsigned threads, size_t ops)
+{
+    static constexpr size_t N = 16;
+    static constexpr uint32_t START = 1000;
+    Array arr;
+    arr.init_on_node(N, 0);
+    for (size_t i = 0; i < N; ++i) arr.store(i, item(START));
+    RluArray<PackedMode::MODE_VALUE32> rlu(arr, 2 * threads);
+
+    std::atomic<size_t> torn{0}, reads{0};
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> th;
+    for (unsigned t = 0; t < threads; ++t) th.emplace_back([&] {
+        const uint32_t id = rlu.register_thread();
+        while (!stop.load(std::memory_order_relaxed)) {
+            rlu.reader_lock(id);
+            uint64_t sum = 0;
+            for (size_t i = 0; i < N; ++i) sum += value(rlu.read(id, i));
+            rlu.reader_unlock(id);
+            if (sum != N * START) torn.fetch_add(1, std::memory_order_relaxed);
+            reads.fetch_add(1, std::memory_order_relaxed);
+            std::this_thread::yield();
+        }
+        rlu.unregister_thread(id);
+    });
+    std::vector<std::thread> wr;
+    for (unsigned t = 0; t < threads; ++t) wr.emplace_back([&, t] {
+        const uint32_t id = rlu.register_thread();
+        std::mt19937 rng(t + 21);
+        for (size_t i = 0; i < ops; ++i) {
+            const size_t from = rng() % N;
+            const size_t to = (from + 1 + rng() % (N - 1)) % N;
+            while (true) {
+                rlu.reader_lock(id);
+                const uint32_t a = value(rlu.read(id, from));
+                const uint32_t b = value(rlu.read(id, to));
+                if (a == 0) { rlu.reader_unlock(id); break; }
+                if (rlu.write(id, from, item(a - 1)) && rlu.write(id, to, item(b + 1))) {
+                    if (i % 64 == 0) std::this_thread::yield(); // let readers meet the locked cells
+                    rlu.reader_unlock(id);
+                    break;
+                }
+                rlu.abort(id);
+            }
+        }
+        rlu.unregister_thread(id);
+    });
+    for (auto &t : wr) t.join();
+    stop.store(true);
+    for (auto &t : th) t.join();
+
+    uint64_t sum = 0;
+    for (size_t i = 0; i < N; ++i) sum += value(arr.load(i));
+    check(sum == N * START, "rlu final total changed");
+    check(torn.load() == 0, "rlu reader saw a partially committed section");
+    std::printf("rlu         reads=%zu torn=%zu commits=%llu\n", reads.load(), torn.load(),
+                static_cast<unsigned long long>(rlu.clock()));
+}
+
+static void test_checkpoint(unsigned threads, size_t ops)
+{
+    static constexpr size_t N = 4096;
+    const std::string path = (std::filesystem::temp_directory_path() /
+                              ("acs_selftest_" + std::to_string(::getpid()) + ".pc")).string();
+    std::filesystem::remove(path);
+    {
+        Array arr;
+        arr.init_from_file(path, N);
+        check(arr.file_backed(), "init_from_file did not map the file");
+        std::vector<std::thread> th;
+        for (unsigned t = 0; t < threads; ++t) th.emplace_back([&, t] {
+            for (size_t i = t; i < N; i += threads) arr.store(i, item(static_cast<uint32_t>(i * 7 + 1)));
+            arr.checkpoint_range(t * N / threads, (t + 1) * N / threads);
+        });
+        for (auto &t : th) t.join();
+        arr.checkpoint();
+    }
+    size_t bad = 0;
+    {
+        Array arr;
+        arr.init_from_file(path, N);
+        for (size_t i = 0; i < N; ++i) bad += arr.load(i) != item(static_cast<uint32_t>(i * 7 + 1));
+    }
+    check(bad == 0, "checkpointed cells differ after reopen");
+    bool refused = false;
+    try {
+        Array arr;
+        arr.init_from_file(path, N + 1);
+    } catch (const std::runtime_error &) {
+        refused = true;
+    }
+    check(refused, "reopen with a different n was accepted");
+    std::filesystem::remove(path);
+    std::printf("checkpoint  cells=%zu mismatched=%zu\n", N, bad);
+    (void)ops;
+}
+
+static void test_shm(unsigned threads, size_t ops)
+{
+    using Shm = ShmMailbox<PackedMode::MODE_VALUE32>;
+    const std::string name = "/acs_selftest_" + std::to_string(::getpid());
+    const size_t items = std::min<size_t>(ops, 4096);
+    Shm::unlink(name);
+
+    Shm creator(name, ShmOpen::CREATE, 256);
+    bool exclusive = false;
+    try {
+        Shm again(name, ShmOpen::CREATE, 256);
+    } catch (const std::runtime_error &) {
+        exclusive = true;
+    }
+    check(exclusive, "second CREATE of the same name succeeded");
+
+    // consumers attach by name; each item value is seen exactly once
+    std::vector<std::atomic<uint8_t>> seen(items);
+    std::atomic<size_t> claimed{0}, attached{0};
+    std::atomic<bool> attach_failed{false}, publish_failed{false};
+    std::vector<std::thread> th;
+    for (unsigned t = 0; t < threads; ++t) th.emplace_back([&] {
+        try {
+            Shm peer(name, ShmOpen::ATTACH);
+            if (peer.capacity() != 256) attach_failed.store(true);
+            attached.fetch_add(1);
+            while (claimed.load() < items && !publish_failed.load()) {
+                size_t idx;
+                packed64_t observed;
+                if (!peer.claim_one_wait(REL_NODE0, idx, observed, 10)) continue;
+                const uint32_t v = value(observed);
+                if (v < items) seen[v].fetch_add(1);
+                peer.commit_index(idx, observed);
+                peer.recycle(idx);
+                claimed.fetch_add(1);
+            }
+        } catch (const std::runtime_error &) {
+            attach_failed.store(true);
+        }
+    });
+    for (size_t i = 0; i < items && !attach_failed.load(); ++i)
+        if (creator.publish_blocking(item(static_cast<uint32_t>(i)), 1000) == SIZE_MAX) {
+            publish_failed.store(true);
+            break;
+        }
+    if (attach_failed.load()) publish_failed.store(true);
+    for (auto &t : th) t.join();
+    Shm::unlink(name);
+
+    check(!attach_failed.load() && attached.load() == threads, "ATTACH by name failed");
+    check(!publish_failed.load() || attach_failed.load(), "shm publish timed out");
+    size_t once = 0;
+    for (auto &s : seen) once += s.load() == 1;
+    check(once == items, "shm items not claimed exactly once");
+    check(creator.occupancy_exact() == 0, "shm occupancy not back to zero");
+    std::printf("shm         items=%zu claimed_once=%zu\n", items, once);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned threads = 2;
+    size_t ops = 20000;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a.rfind("threads=", 0) == 0) threads = static_cast<unsigned>(std::atoi(a.c_str() + 8));
+        else if (a.rfind("ops=", 0) == 0) ops = static_cast<size_t>(std::atoll(a.c_str() + 4));
+        else {
+            std::fprintf(stderr, "usage: %s [threads=2] [ops=20000]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (threads < 2 || ops == 0) {
+        std::fprintf(stderr, "threads must be >= 2 and ops > 0\n");
+        return 2;
+    }
+
+    try {
+        test_kcas(threads, ops);
+        test_rlu(threads, ops);
+        test_checkpoint(threads, ops);
+        test_shm(threads, ops);
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "  FAILED: %s\n", e.what());
+        ++failures;
+    }
+    std::printf("%s (%d failure%s)\n", failures ? "FAIL" : "OK", failures, failures == 1 ? "" : "s");
+    return failures ? 1 : 0;
+}